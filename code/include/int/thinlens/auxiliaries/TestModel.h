@@ -6,30 +6,7 @@
 #include <glm/glm.hpp>
 #include <vector>
 
-// Used to describe a triangular surface:
-class Triangle
-{
-public:
-	glm::vec3 v0;
-	glm::vec3 v1;
-	glm::vec3 v2;
-	glm::vec3 normal;
-	glm::vec3 color;
-	glm::vec3 emittance;
-
-	Triangle( glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 color, glm::vec3 emittance = glm::vec3(0,0,0))
-		: v0(v0), v1(v1), v2(v2), color(color), emittance(emittance)
-	{
-		ComputeNormal();
-	}
-
-	void ComputeNormal()
-	{
-		glm::vec3 e1 = v1-v0;
-		glm::vec3 e2 = v2-v0;
-		normal = glm::normalize( glm::cross( e2, e1 ) );
-	}
-};
+#include <thinlens/scene/triangle.h>
 
 // Loads the Cornell Box. It is scaled to fill the volume:
 // -1 <= x <= +1
@@ -181,4 +158,53 @@ void LoadTestModel( std::vector<Triangle>& triangles )
 	// triangles.push_back(Triangle(a,c,d,glm::vec3(0,0,0),3.4f*glm::vec3(1,1,1)));
 }
 
+// Adds an n x n grid of small emissive quads just below the 
+// ceiling of the Cornell Box, facing into the room. The 
+// emittance of each quad is scaled so that the total power 
+// of the grid does not depend on n.
+void AddCeilingLights( std::vector<Triangle>& triangles, int n, glm::vec3 emittance )
+{
+	using glm::vec3;
+
+	if( n <= 0 )
+		return;
+
+	// the grid covers [-0.3, 0.3] in x and z, with gaps between quads
+	float extent = 0.6f;
+	float cell = extent / n;
+	float size = 0.8f * cell;
+	vec3 Le = emittance * (extent * extent / (n * n * size * size));
+
+	// the ceiling is at y = -1 after the flips in LoadTestModel
+	float y = -0.99f;
+	vec3 black( 0, 0, 0 );
+
+	for( int i=0; i<n; ++i )
+	{
+		for( int j=0; j<n; ++j )
+		{
+			float x0 = -0.5f * extent + i * cell + 0.1f * cell;
+			float z0 = -0.5f * extent + j * cell + 0.1f * cell;
+
+			vec3 A( x0, y, z0 );
+			vec3 B( x0 + size, y, z0 );
+			vec3 C( x0, y, z0 + size );
+			vec3 D( x0 + size, y, z0 + size );
+
+			Triangle t0( A, C, B, black, Le );
+			Triangle t1( B, C, D, black, Le );
+
+			// face downwards (+y) into the room
+			if( t0.normal.y < 0 )
+			{
+				t0 = Triangle( A, B, C, black, Le );
+				t1 = Triangle( B, D, C, black, Le );
+			}
+
+			triangles.push_back( t0 );
+			triangles.push_back( t1 );
+		}
+	}
+}
+
 #endif
\ No newline at end of file
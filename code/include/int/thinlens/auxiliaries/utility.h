@@ -1,6 +1,8 @@
 #include <thinlens/auxiliaries/TestModel.h>
 #include <glm/glm.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <random>
 
 #define PI 3.141592653589793238462643383279502884
@@ -22,9 +24,10 @@ struct Intersection{
 	int triangleIndex;
 };
 
-std::random_device rd;  //Will be used to obtain a seed for the random number engine
+std::random_device rd;  // picks the render seed when none is given
 
 using namespace std;
+using glm::vec2;
 using glm::vec3;
 using glm::mat3;
 
@@ -38,49 +41,96 @@ vec3 projectAOntoB(const vec3 & a, const vec3 & b){
 }
 
 /*
-    Returns a uniform sphere sample.
+    Luminance of a linear RGB color.
 */
-vec3 uniformSphereSample(float r){
-
-    std::uniform_real_distribution<float> dis(0, 1.0);
-
-    float theta0 = 2*PI*dis(rd);
-    float theta1 = acos(1 - 2*dis(rd));
-
-    vec3 dir = vec3(sin(theta1)*sin(theta0), sin(theta1)*cos(theta0), cos(theta1)); 
-
-    dir = r * glm::normalize(dir);
-
-    return dir;
+float luminance(const vec3 & c){
+    return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
 }
 
 /*
-    PDF for uniform sphere sample.
+    Builds an orthonormal basis (t, b, n) around the unit
+    vector n (Duff et al., "Building an Orthonormal Basis,
+    Revisited").
 */
-float uniformSphereSamplePDF(float r){
-    return 1/(r*r*4*PI);
+void coordinateSystem(const vec3 & n, vec3 & t, vec3 & b){
+    float sign = n.z >= 0 ? 1.0f : -1.0f;
+    float a = -1 / (sign + n.z);
+    float c = n.x * n.y * a;
+    t = vec3(1 + sign * n.x * n.x * a, sign * c, -sign * n.x);
+    b = vec3(c, sign + n.y * n.y * a, -n.y);
 }
 
 /*
-    Sample hemisphere uniformly around an axis.
+    Maps a uniform sample in [0,1)^2 to a uniform point on
+    the unit disk, keeping the stratification of the input
+    intact (Shirley and Chiu's concentric mapping).
 */
-vec3 uniformHemisphereSample(const vec3 & axis, float r){
-
-    std::uniform_real_distribution<float> dis(0, 1.0);
+vec2 concentricSampleDisk(const vec2 & u){
+    vec2 uOffset = 2.f * u - vec2(1, 1);
+
+    if (uOffset.x == 0 && uOffset.y == 0)
+        return vec2(0, 0);
+
+    float theta, r;
+    if (std::abs(uOffset.x) > std::abs(uOffset.y)) {
+        r = uOffset.x;
+        theta = PI/4 * (uOffset.y / uOffset.x);
+    } else {
+        r = uOffset.y;
+        theta = PI/2 - PI/4 * (uOffset.x / uOffset.y);
+    }
+    return r * vec2(std::cos(theta), std::sin(theta));
+}
 
-    float theta0 = 2*PI*dis(rd);
-    float theta1 = acos(1 - 2*dis(rd));
+/*
+    Get PDF for a uniform hemisphere sample.
+*/
+float uniformHemisphereSamplePDF(float r){
+    return 1 / (r*r*2*PI);
+}
 
-    vec3 dir = vec3(sin(theta1)*sin(theta0), sin(theta1)*cos(theta0), cos(theta1)); 
+/*
+    Sample a unit direction in the hemisphere around the
+    (unit) axis with density proportional to the cosine 
+    of the angle to the axis: a uniform disk sample is 
+    projected up onto the hemisphere (Malley's method).
+
+    For Lambertian surfaces the cosine and the PDF cancel
+    the cosine term of the rendering equation, so the
+    estimate is just reflectance * incoming radiance.
+*/
+vec3 cosineHemisphereSample(const vec3 & axis, const vec2 & u){
+    vec2 d = concentricSampleDisk(u);
+    float z = std::sqrt(std::max(0.0f, 1 - d.x*d.x - d.y*d.y));
 
-    dir = glm::normalize(projectAOntoB(axis, dir));
+    vec3 t, b;
+    coordinateSystem(axis, t, b);
+    return d.x * t + d.y * b + z * axis;
+}
 
-    return dir;
+/*
+    Get PDF (per unit solid angle) of a cosine-weighted 
+    hemisphere sample, given the cosine of its angle to
+    the axis.
+*/
+float cosineHemisphereSamplePDF(float cosTheta){
+    return cosTheta > 0 ? cosTheta / PI : 0;
 }
 
 /*
-    Get PDF for a uniform hemisphere sample.
+    Multiple importance sampling weights for a sample taken
+    from strategy f (nf samples, density fPdf), when strategy
+    g (ng samples, density gPdf) could have produced it too
+    (Veach's balance and power heuristics).
 */
-float uniformHemisphereSamplePDF(float r){
-    return 1 / (r*r*2*PI);
-}
\ No newline at end of file
+float balanceHeuristic(int nf, float fPdf, int ng, float gPdf){
+    float f = nf * fPdf;
+    float g = ng * gPdf;
+    return f + g > 0 ? f / (f + g) : 0;
+}
+
+float powerHeuristic(int nf, float fPdf, int ng, float gPdf){
+    float f = nf * fPdf;
+    float g = ng * gPdf;
+    return f*f + g*g > 0 ? (f*f) / (f*f + g*g) : 0;
+}
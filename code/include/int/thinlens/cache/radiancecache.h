@@ -0,0 +1,64 @@
+#ifndef RADIANCE_CACHE_H
+#define RADIANCE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+    Mean radiance leaving the surfaces in the cells of a
+    uniform grid over world space, stored in a hash table of
+    fixed size (Binder et al., "Massively Parallel Path Space
+    Filtering"). Cells are keyed by their position, quantized
+    to cellSize, and by the axis the surface normal is closest
+    to, so that the two sides of a thin wall or the walls of
+    a corner do not share a cell. Only cells that paths
+    actually visit take up space.
+
+    Add and Lookup are lock-free and can be called by any
+    number of threads at once. When the table is full (or a
+    key finds no free slot near its hash), new cells are not
+    stored.
+*/
+class RadianceCache {
+public:
+    RadianceCache(float cellSize, size_t memoryBytes);
+
+    // adds a sample of the radiance leaving the surface at p with normal n
+    void Add(const glm::vec3& p, const glm::vec3& n, const glm::vec3& radiance);
+
+    /*
+        Mean radiance leaving the cell of p, if it has at
+        least minSamples samples. Returns false otherwise.
+    */
+    bool Lookup(const glm::vec3& p, const glm::vec3& n, uint32_t minSamples, glm::vec3& radiance) const;
+
+    size_t Capacity() const { return entries.size(); }
+
+    // number of cells stored so far
+    size_t Cells() const { return cells.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        Entry();
+
+        std::atomic<uint64_t> key; // 0 for empty slots
+        std::atomic<uint32_t> count;
+        std::atomic<float> sum[3];
+    };
+
+    uint64_t Key(const glm::vec3& p, const glm::vec3& n) const;
+
+    // slot holding key, or -1; with insert, claims a free slot for it
+    long Find(uint64_t key, bool insert);
+    long Find(uint64_t key) const;
+
+    float cellSize;
+    std::vector<Entry> entries; // a power of two of them
+    std::atomic<size_t> cells;
+};
+
+#endif
@@ -2,7 +2,7 @@
 #define CAMERA_H
 
 #include <glm/glm.hpp>
-#include <bmp/bmp.h>
+#include <thinlens/film/film.h>
 
 using glm::mat4;
 using glm::vec2;
@@ -36,12 +36,12 @@ public:
     mat4 cameraToWorld;
     float shutterOpen;
     float shutterClose;
-    const bitmap_image& film;
+    const Film& film;
 
     Camera(const mat4& cameraToWorld, 
             float shutterOpen, 
             float shutterClose, 
-            const bitmap_image& film);
+            const Film& film);
 
     /* 
         GenerateRay takes a given space-time CameraSample
@@ -53,6 +53,28 @@ public:
     */
     virtual float GenerateRay(const CameraSample& sample, Ray& ray) const = 0;
 
+    /*
+        The other way around, for paths traced from the lights:
+        We returns the importance emitted along a world space
+        ray that leaves the lens, and where on the film (in 
+        raster space) the ray comes from; zero if it does not
+        come from the film. PdfWe gives the densities that 
+        GenerateRay samples the origin (per area of the lens) 
+        and the direction (per solid angle) of that ray with.
+
+        SampleWi samples a point on the lens as seen from the
+        world space point p: it stores the unit direction wi
+        from p to the lens point, the point itself and the 
+        density of having sampled it (per solid angle at p), 
+        and returns We of the ray from the lens point to p.
+
+        Cameras that cannot be reached this way return zero.
+    */
+    virtual float We(const Ray& /* ray */, vec2& /* pRaster */) const { return 0; }
+    virtual void PdfWe(const Ray& /* ray */, float& pdfPos, float& pdfDir) const { pdfPos = pdfDir = 0; }
+    virtual float SampleWi(const glm::vec3& /* p */, const vec2& /* u */, glm::vec3& /* wi */,
+                           glm::vec3& /* pLens */, float& /* pdf */, vec2& /* pRaster */) const { return 0; }
+
     /* TODO */
     virtual float GenerateRayDifferential(const CameraSample& sample, RayDifferential& rd);
 
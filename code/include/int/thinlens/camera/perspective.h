@@ -4,7 +4,7 @@
 #include <thinlens/camera/camera.h>
 #include <thinlens/camera/projective.h>
 
-#include <bmp/bmp.h>
+#include <thinlens/film/film.h>
 #include <glm/glm.hpp>
 
 using glm::vec4;
@@ -21,13 +21,25 @@ public:
     PerspectiveCamera(const mat4 &cameraToWorld, const mat2& screenWindow,
                float shutterOpen, float shutterClose, 
                float lensr, float focald, float fovy,
-               const bitmap_image& film);
+               const Film& film);
 
     // not necessary to declare in ProjectiveCamera, inheritance will still work;
     // should probably do it for clarity though
     float GenerateRay(const CameraSample& sample, Ray& ray) const override;
+
+    float We(const Ray& ray, vec2& pRaster) const override;
+    void PdfWe(const Ray& ray, float& pdfPos, float& pdfDir) const override;
+    float SampleWi(const glm::vec3& p, const vec2& u, glm::vec3& wi,
+                   glm::vec3& pLens, float& pdf, vec2& pRaster) const override;
 protected:
+    // cosine between the camera space direction d and the view direction,
+    // zero if d does not come from the film
+    float FilmCosine(const Ray& ray, vec2& pRaster) const;
+
     vec4 dxCamera, dyCamera;
+    mat4 worldToCamera, cameraToRaster;
+    float imageArea; // of the film, projected onto the plane at distance 1
+    float lensArea;
 };
 
 #endif
\ No newline at end of file
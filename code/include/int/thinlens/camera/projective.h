@@ -2,7 +2,7 @@
 #define PROJECTIVE_CAMERA_H
 
 #include <thinlens/camera/camera.h>
-#include <bmp/bmp.h>
+#include <thinlens/film/film.h>
 #include <glm/glm.hpp>
 
 using glm::mat2;
@@ -18,7 +18,7 @@ public:
     ProjectiveCamera(const mat4 &cameraToWorld, 
                const mat4 &cameraToScreen, const mat2& screenWindow,
                float shutterOpen, float shutterClose, float lensr, float focald,
-               const bitmap_image& film);
+               const Film& film);
                
 protected:
     mat4 cameraToScreen, rasterToCamera;
@@ -0,0 +1,61 @@
+#ifndef AOVS_H
+#define AOVS_H
+
+#include <vector>
+
+#include <bmp/bmp.h>
+#include <glm/glm.hpp>
+
+/*
+    Auxiliary buffers of the first thing seen through every
+    pixel: the albedo and shading normal of the surface and 
+    its distance from the camera, averaged over the samples 
+    of the pixel. They are nearly free of noise compared to 
+    the radiance, which is what makes them good guides for 
+    the denoiser.
+*/
+class AOVBuffer {
+public:
+    AOVBuffer(int width, int height);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    /*
+        Adds a sample to a pixel. Not synchronised, just like 
+        Film::AddSample.
+    */
+    void AddSample(int x, int y, const glm::vec3& albedo, const glm::vec3& normal, float depth) {
+        size_t i = size_t(y) * width + x;
+        ar[i] += albedo.r;
+        ag[i] += albedo.g;
+        ab[i] += albedo.b;
+        nx[i] += normal.x;
+        ny[i] += normal.y;
+        nz[i] += normal.z;
+        z[i] += depth;
+        n[i] += 1;
+    }
+
+    glm::vec3 Albedo(int x, int y) const;
+    glm::vec3 Normal(int x, int y) const; // unit length, or zero without samples
+    float Depth(int x, int y) const;
+
+    /*
+        Conversion to images: albedo as is, normals mapped 
+        from [-1, 1] to [0, 255], and depths up to maxDepth 
+        from white (near) to black (far).
+    */
+    void ResolveAlbedo(bitmap_image& image) const;
+    void ResolveNormal(bitmap_image& image) const;
+    void ResolveDepth(float maxDepth, bitmap_image& image) const;
+
+private:
+    int width, height;
+    std::vector<float> ar, ag, ab;
+    std::vector<float> nx, ny, nz;
+    std::vector<float> z;
+    std::vector<float> n;
+};
+
+#endif
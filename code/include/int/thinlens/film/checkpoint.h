@@ -0,0 +1,85 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    A checkpoint is a snapshot of the accumulation buffer
+    together with everything needed to continue the render
+    where it left off: the number of samples per pixel that
+    went into the snapshot and the seed of the random number
+    engine (which is reseeded from the seed at every pass).
+
+    File layout: one header page followed by two slots.
+    Snapshots are written to the slot that is NOT active,
+    synced to disk, and only then is the header flipped to
+    point at the new slot. A crash in the middle of a write
+    therefore always leaves the previous snapshot intact.
+*/
+struct CheckpointData {
+    int width;
+    int height;
+    int channels;
+    uint64_t samples;
+    uint64_t seed;
+    std::vector<float> pixels; // row-major, channels floats per pixel
+};
+
+/*
+    Reads the latest complete snapshot of a checkpoint file.
+    Returns false (and reports why on stderr) if the file
+    could not be read or is not a valid checkpoint.
+*/
+bool LoadCheckpoint(const std::string& path, CheckpointData& data);
+
+/*
+    Writes snapshots into a memory-mapped checkpoint file on
+    a background thread, so that the render loop only pays
+    for copying the buffer.
+*/
+class CheckpointWriter {
+public:
+    CheckpointWriter(const std::string& path, int width, int height, int channels);
+
+    // waits for any pending snapshot to be written
+    ~CheckpointWriter();
+
+    bool IsOpen() const { return mapping != nullptr; }
+
+    /*
+        Queues a snapshot and returns immediately. If the
+        writer is still busy with an earlier snapshot, the
+        queued one is replaced by this newer one.
+    */
+    void Submit(const std::vector<float>& pixels, uint64_t samples, uint64_t seed);
+
+    // blocks until every submitted snapshot is on disk
+    void Flush();
+
+private:
+    void Run();
+    void WriteSlot(const std::vector<float>& pixels, uint64_t samples, uint64_t seed);
+
+    int width, height, channels;
+    size_t slotSize;
+    size_t fileSize;
+    unsigned char* mapping;
+
+    std::vector<float> pending;
+    uint64_t pendingSamples;
+    uint64_t pendingSeed;
+    bool hasPending;
+    bool writing;
+    bool done;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <thinlens/film/aovs.h>
+#include <thinlens/film/film.h>
+
+/*
+    Parameters of the edge-stopping functions: the larger a
+    sigma, the more the filter blurs across differences in
+    luminance (in standard deviations of the pixel's noise)
+    and depth. The normal exponent works the other way around.
+*/
+struct DenoiseSettings {
+    int iterations = 5;           // filter radius is 2^(iterations + 1) pixels
+    float sigmaLuminance = 4;
+    float normalExponent = 128;
+    float sigmaDepth = 0.05f;     // scene units per pixel of filter step
+};
+
+/*
+    Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010)
+    with the variance-guided luminance weights of SVGF 
+    (Schied et al. 2017): a 5x5 B3-spline kernel is applied 
+    iterations times with doubling gaps between its taps, and
+    every tap is weighted down by how much its normal, depth 
+    and luminance differ from the centre pixel's. Luminance 
+    differences are measured relative to the standard error
+    of the pixel (Film::Variance), which is filtered along.
+
+    Radiance is divided by the albedo before filtering and 
+    multiplied back afterwards, so that the filter smooths 
+    lighting but keeps the edges between differently coloured
+    surfaces.
+
+    Rows are split between numThreads threads. Returns a film
+    with a single sample per pixel.
+*/
+Film Denoise(const Film& film, const AOVBuffer& aovs, const DenoiseSettings& settings, int numThreads);
+
+#endif
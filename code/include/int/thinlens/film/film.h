@@ -0,0 +1,253 @@
+#ifndef FILM_H
+#define FILM_H
+
+#include <string>
+#include <vector>
+
+#include <bmp/bmp.h>
+#include <glm/glm.hpp>
+
+#include <thinlens/film/checkpoint.h>
+#include <thinlens/film/filter.h>
+
+/*
+    Curves that map unbounded radiance into [0, 1] before
+    quantization. None simply clamps.
+*/
+enum class ToneMap {
+    None,
+    Reinhard,
+    ACES
+};
+
+bool ParseToneMap(const std::string& name, ToneMap& toneMap);
+
+struct ResolveSettings {
+    float exposure = 1;
+    ToneMap toneMap = ToneMap::None;
+    bool srgb = false; // encode with the sRGB transfer curve instead of linearly
+};
+
+/*
+    The pixels [x0, x1) x [y0, y1) of a frame, e.g the part
+    of it that is rendered.
+*/
+struct CropWindow {
+    int x0, y0;
+    int x1, y1;
+
+    int Width() const { return x1 - x0; }
+    int Height() const { return y1 - y0; }
+};
+
+// parses "<width>x<height>", e.g "3840x2160"
+bool ParseResolution(const std::string& text, int& width, int& height);
+
+// parses "<x0>,<y0>,<x1>,<y1>", in pixels; the window must not be empty
+bool ParseCropWindow(const std::string& text, CropWindow& crop);
+
+class FilmTile;
+
+/*
+    The film accumulates weighted radiance samples in float
+    and is only converted to 8-bit when an image is needed
+    (a preview or the final output), by Resolve.
+
+    Channels are stored as separate planes so that the
+    resolve loops run over contiguous floats and vectorize.
+
+    Next to the sums, the film tracks the number of samples,
+    mean and variance of the luminance of every pixel (with
+    Welford's online algorithm), which is what adaptive
+    sampling decides on. These statistics belong to the pixel
+    a sample was taken for, while the sums are reconstructed
+    with the film's filter, which may spread a sample over
+    the pixels around it (see FilmTile).
+
+    With more than one bucket, samples are also dealt out 
+    round-robin into that many partial sums per pixel, and 
+    the value of a pixel is the median of the means of its 
+    buckets. A rare, very bright sample only raises the mean 
+    of its own bucket, so it is rejected instead of showing 
+    up as a firefly; the price is a bias towards darker 
+    values in pixels whose light mostly arrives through such
+    rare samples.
+*/
+class Film {
+public:
+    static const int MAX_BUCKETS = 32;
+
+    Film(int width, int height, int buckets = 1, const Filter& filter = Filter());
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int Buckets() const { return buckets; }
+    const Filter& GetFilter() const { return filter; }
+
+    /*
+        Adds a sample to a pixel, unfiltered. Not synchronised:
+        threads must add to disjoint pixels (e.g different 
+        tiles).
+    */
+    void AddSample(int x, int y, const glm::vec3& L, float weight = 1) {
+        size_t i = size_t(y) * width + x;
+        r[i] += weight * L.r;
+        g[i] += weight * L.g;
+        b[i] += weight * L.b;
+        w[i] += weight;
+
+        if (buckets > 1) {
+            size_t k = size_t(count[i]) % buckets * r.size() + i;
+            bucketR[k] += weight * L.r;
+            bucketG[k] += weight * L.g;
+            bucketB[k] += weight * L.b;
+            bucketW[k] += weight;
+        }
+
+        AddStatistics(x, y, L);
+    }
+
+    /*
+        Counts a sample towards the statistics of a pixel 
+        only. Not synchronised, like AddSample.
+    */
+    void AddStatistics(int x, int y, const glm::vec3& L) {
+        size_t i = size_t(y) * width + x;
+        float l = 0.2126f * L.r + 0.7152f * L.g + 0.0722f * L.b;
+        float delta = l - lumMean[i];
+        count[i] += 1;
+        lumMean[i] += delta / count[i];
+        lumM2[i] += delta * (l - lumMean[i]);
+    }
+
+    /*
+        Splats are samples that land on some other pixel than
+        the one being rendered (in BDPT, light paths connected
+        to the camera). They are kept apart from the pixel 
+        samples: every pixel adds the sum of its splats divided
+        by the number of light paths traced per pixel, which 
+        AddSplatWeight accumulates. Not synchronised either.
+    */
+    void AddSplat(int x, int y, const glm::vec3& L) {
+        size_t i = size_t(y) * width + x;
+        splatR[i] += L.r;
+        splatG[i] += L.g;
+        splatB[i] += L.b;
+    }
+
+    void AddSplatWeight(float weight) { splatWeight += weight; }
+
+    // weighted average of the samples of a pixel (median of means with buckets), plus splats
+    glm::vec3 Pixel(int x, int y) const;
+
+    // number of samples added to a pixel
+    int SampleCount(int x, int y) const { return int(count[size_t(y) * width + x]); }
+
+    // fewest samples of any pixel in the window, or of the whole film
+    int MinSampleCount(const CropWindow& window) const;
+    int MinSampleCount() const { return MinSampleCount(CropWindow{ 0, 0, width, height }); }
+
+    /*
+        Mean luminance of the samples taken for a pixel, 
+        unfiltered. Unlike Pixel, only the thread that owns the
+        pixel writes to it while tiles are being merged.
+    */
+    float MeanLuminance(int x, int y) const { return lumMean[size_t(y) * width + x]; }
+
+    /*
+        Estimated variance of a pixel's luminance, i.e of the
+        mean of its samples (not of a single sample). Zero 
+        with fewer than two samples.
+    */
+    float Variance(int x, int y) const;
+
+    /*
+        Estimated standard error of a pixel's luminance,
+        relative to the luminance itself (floored, so that 
+        dark pixels do not need an unbounded number of 
+        samples). Infinite with fewer than two samples.
+    */
+    float RelativeError(int x, int y) const;
+
+    // average of all pixels that have samples
+    glm::vec3 Mean() const;
+
+    // adds the samples of another film of the same size and number of buckets
+    void Merge(const Film& other);
+
+    /*
+        Adds the filtered sums of a tile. Tiles overlap where
+        the filter reaches beyond their pixels, so merges must
+        be serialised by the caller.
+    */
+    void MergeTile(const FilmTile& tile);
+
+    // converts the film to 8-bit and writes it into image
+    void Resolve(const ResolveSettings& settings, bitmap_image& image) const;
+
+    /*
+        Writes the number of samples of every pixel, relative 
+        to the largest, into image as grey levels.
+    */
+    void ResolveSampleCount(bitmap_image& image) const;
+
+    /*
+        Conversion to and from the checkpoint layout: per 
+        pixel the weighted sums of r, g and b, the sum of 
+        weights, and the sample count, mean and sum of 
+        squared deviations of the luminance, the sums of the 
+        splats and the splat weight, followed by BUCKET_CHANNELS (the same sums as the first four) 
+        per bucket if there is more than one.
+    */
+    static const int CHANNELS = 11;
+    static const int BUCKET_CHANNELS = 4;
+    int Channels() const { return buckets > 1 ? CHANNELS + BUCKET_CHANNELS * buckets : CHANNELS; }
+    std::vector<float> Snapshot() const;
+    bool Restore(const CheckpointData& data);
+
+private:
+    glm::vec3 MedianOfMeans(size_t i) const;
+
+    int width, height;
+    int buckets;
+    Filter filter;
+    std::vector<float> r, g, b, w;
+    std::vector<float> count, lumMean, lumM2;
+    std::vector<float> splatR, splatG, splatB;
+    float splatWeight;
+    std::vector<float> bucketR, bucketG, bucketB, bucketW; // bucket-major planes
+
+};
+
+/*
+    The samples one thread takes for a tile of pixels, before
+    they go into the film. A sample is reconstructed with the
+    film's filter into every pixel within its radius, which 
+    can lie in a neighbouring tile, so a FilmTile also covers
+    a border as wide as the filter reaches around its pixels;
+    Film::MergeTile adds it to the film once the tile is done.
+*/
+class FilmTile {
+public:
+    // for the pixels [x0, x1) x [y0, y1) of film
+    FilmTile(Film& film, int x0, int y0, int x1, int y1);
+
+    /*
+        Adds a sample taken for pixel (x, y) of the tile at 
+        pFilm, in raster space within that pixel. Its radiance
+        goes into the tile; the pixel's statistics are updated
+        in the film right away, which needs no lock as no 
+        other tile has that pixel.
+    */
+    void AddSample(int x, int y, const glm::vec2& pFilm, const glm::vec3& L);
+
+private:
+    friend class Film;
+
+    Film& film;
+    int x0, y0, x1, y1; // pixels covered, including the border
+    std::vector<float> r, g, b, w;
+    std::vector<float> bucketR, bucketG, bucketB, bucketW; // bucket-major planes
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <string>
+
+/*
+    Reconstruction filters, which spread every sample over the
+    pixels within their radius of it. Box with a radius of
+    half a pixel gives each pixel the plain average of the
+    samples that fall in it; the wider ones trade a little
+    sharpness for smoother edges, and Mitchell's negative lobes
+    bring some of the sharpness back.
+*/
+enum class FilterType {
+    Box,
+    Tent,
+    Gaussian,
+    Mitchell
+};
+
+bool ParseFilter(const std::string& name, FilterType& type);
+
+// radius each filter is usually used with, in pixels
+float DefaultFilterRadius(FilterType type);
+
+/*
+    All four filters are separable, so the weight of a sample
+    for a pixel is the product of one function of the x and
+    one of the y distance between them. That function is
+    tabulated once over [0, radius), so adding a sample costs
+    two lookups per pixel it reaches.
+*/
+class Filter {
+public:
+    static const int TABLE_SIZE = 64;
+
+    Filter(FilterType type = FilterType::Box, float radius = 0.5f);
+
+    FilterType Type() const { return type; }
+    float Radius() const { return radius; }
+
+    // weight at a distance of dx, dy pixels, both at most the radius
+    float Evaluate(float dx, float dy) const { return Evaluate1D(dx) * Evaluate1D(dy); }
+
+    float Evaluate1D(float d) const {
+        int i = int((d < 0 ? -d : d) * scale);
+        return table[i < TABLE_SIZE ? i : TABLE_SIZE - 1];
+    }
+
+private:
+    FilterType type;
+    float radius;
+    float scale; // TABLE_SIZE / radius
+    float table[TABLE_SIZE];
+};
+
+#endif
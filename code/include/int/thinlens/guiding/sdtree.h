@@ -0,0 +1,120 @@
+#ifndef SD_TREE_H
+#define SD_TREE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+    Distribution of directions over the sphere, learned from
+    samples of incident radiance (Müller et al., "Practical
+    Path Guiding for Efficient Light-Transport Simulation").
+    Directions are mapped to the unit square with the equal
+    area cylindrical mapping (cos theta, phi), which is
+    split into a quadtree: every node keeps the radiance
+    recorded in each of its four quadrants, and quadrants
+    holding much of their tree's energy are split further.
+
+    Recording is lock-free, so render threads can record
+    into the same tree concurrently; sampling and Pdf only
+    read, and must not be used on a tree being recorded into.
+*/
+class DTree {
+public:
+    DTree();
+    DTree(const DTree& other);
+    DTree& operator=(const DTree& other);
+
+    // adds radiance (over the density it was sampled with) in direction w
+    void Record(const glm::vec3& w, float radiance);
+
+    // number of Record calls since the last Refine
+    uint64_t SampleCount() const { return samples.load(std::memory_order_relaxed); }
+
+    // true until something with a positive radiance has been recorded
+    bool Empty() const;
+
+    // direction for u in [0, 1)^2, with its density per solid angle
+    glm::vec3 Sample(glm::vec2 u, float& pdf) const;
+    float Pdf(const glm::vec3& w) const;
+
+    /*
+        Rebuilds the quadtree from the radiance recorded so
+        far: quadrants with more than threshold of the total
+        are split (up to maxDepth levels), the others are
+        merged. Clears the recorded radiance.
+    */
+    void Refine(float threshold, int maxDepth);
+
+    // halves the sample count, for the two halves of a split region
+    void HalveSampleCount();
+
+private:
+    struct Node {
+        Node();
+        Node(const Node& other);
+        Node& operator=(const Node& other);
+
+        // quadrant q = x + 2 * y covers [x, x + 1] x [y, y + 1] / 2 of the node
+        std::atomic<float> sum[4];
+        int child[4]; // 0 for quadrants that are not split (the root is no child)
+    };
+
+    int Subdivide(const std::vector<Node>& old, int oldIndex, const float sums[4],
+                  float total, float threshold, int depth, int maxDepth);
+
+    std::vector<Node> nodes;
+    std::atomic<uint64_t> samples;
+};
+
+/*
+    Spatio-directional tree: a binary tree over the bounding
+    box of the scene, split in the middle along x, y and z
+    in turn, with a pair of DTrees in every leaf. Paths are
+    sampled from the sampling tree of the leaf, learned in
+    the previous training iteration, while the current one
+    records into the building tree. Refine turns the
+    building trees into the sampling trees of the next
+    iteration, splitting leaves that received many samples.
+*/
+class SDTree {
+public:
+    SDTree(const glm::vec3& pMin, const glm::vec3& pMax);
+
+    // leaf whose region contains p (or is nearest to it, for points outside)
+    int Leaf(const glm::vec3& p) const;
+    int Leaves() const { return leaves.size(); }
+
+    const DTree& Sampling(int leaf) const { return leaves[leaf].sampling; }
+    DTree& Building(int leaf) { return leaves[leaf].building; }
+
+    /*
+        Ends a training iteration (counting from 0): leaves
+        with more than 12000 sqrt(2^iteration) samples are
+        split, then every building tree becomes a sampling
+        tree and is refined for the next iteration.
+    */
+    void Refine(int iteration);
+
+private:
+    struct Node {
+        int axis;
+        int child; // the second child follows the first; 0 for leaves
+        int leaf;  // index into leaves, -1 for interior nodes
+    };
+
+    struct Region {
+        DTree sampling;
+        DTree building;
+    };
+
+    void Split(int node, float threshold);
+
+    glm::vec3 pMin, pMax;
+    std::vector<Node> nodes;
+    std::vector<Region> leaves;
+};
+
+#endif
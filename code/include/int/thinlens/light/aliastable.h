@@ -0,0 +1,38 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+    Walker's alias method (built with Vose's algorithm):
+    samples an index i with probability proportional to
+    weights[i] in constant time, using one table lookup
+    and one comparison.
+*/
+class AliasTable {
+public:
+    AliasTable() {}
+    explicit AliasTable(const std::vector<float>& weights);
+
+    size_t Size() const { return bins.size(); }
+
+    /*
+        Samples an index for u in [0, 1) and stores its
+        probability in pmf. The table must not be empty.
+    */
+    int Sample(float u, float& pmf) const;
+
+    float Pmf(int i) const { return bins[i].p; }
+
+private:
+    struct Bin {
+        float q;   // probability of keeping this bin rather than its alias
+        int alias;
+        float p;   // normalized weight of this bin
+    };
+
+    std::vector<Bin> bins;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef DISTRIBUTION_H
+#define DISTRIBUTION_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+    Piecewise-constant density over [0, 1), proportional to
+    the n values of f, sampled by inverting its cumulative
+    distribution. Unlike the alias method, the inversion is
+    monotonic in u, so stratified and low-discrepancy samples
+    stay well distributed after the warp.
+*/
+class Distribution1D {
+public:
+    Distribution1D() : integral(0) {}
+    Distribution1D(const float* f, int n);
+
+    int Count() const { return func.size(); }
+
+    // mean of f over [0, 1)
+    float Integral() const { return integral; }
+
+    /*
+        Point in [0, 1) for u in [0, 1), with its density
+        in pdf and the piece it lies in in offset.
+    */
+    float Sample(float u, float& pdf, int& offset) const;
+
+    // density of the piece offset
+    float Pdf(int offset) const;
+
+private:
+    std::vector<float> func;
+    std::vector<float> cdf; // Count() + 1 entries
+    float integral;
+};
+
+/*
+    Piecewise-constant density over [0, 1)^2, from nu x nv
+    values of f (row-major, v being the row): v is sampled
+    from the marginal distribution of the rows, then u from
+    the conditional distribution of the chosen row.
+*/
+class Distribution2D {
+public:
+    Distribution2D() {}
+    Distribution2D(const float* f, int nu, int nv);
+
+    // point in [0, 1)^2 for u in [0, 1)^2, with its density
+    glm::vec2 Sample(const glm::vec2& u, float& pdf) const;
+    float Pdf(const glm::vec2& p) const;
+
+private:
+    std::vector<Distribution1D> conditional;
+    Distribution1D marginal;
+};
+
+#endif
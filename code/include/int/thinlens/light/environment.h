@@ -0,0 +1,94 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <thinlens/light/distribution.h>
+
+/*
+    Light arriving from infinitely far away, in every
+    direction that leaves the scene. Directions w point from
+    the scene towards the environment, the way a ray that
+    misses everything travels.
+*/
+class Environment {
+public:
+    virtual ~Environment() {}
+
+    // radiance arriving from direction w
+    virtual glm::vec3 Le(const glm::vec3& w) const = 0;
+
+    /*
+        Samples a direction w for u in [0, 1)^2, with its
+        density per solid angle in pdf, and returns the
+        radiance arriving from it. A pdf of 0 means no
+        direction was sampled.
+    */
+    virtual glm::vec3 Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const = 0;
+    virtual float Pdf(const glm::vec3& w) const = 0;
+
+    // mean luminance of Le over all directions
+    virtual float MeanLuminance() const = 0;
+};
+
+// the same radiance from everywhere, sampled uniformly over the sphere
+class ConstantEnvironment : public Environment {
+public:
+    explicit ConstantEnvironment(const glm::vec3& radiance) : radiance(radiance) {}
+
+    glm::vec3 Le(const glm::vec3& /* w */) const { return radiance; }
+    glm::vec3 Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const;
+    float Pdf(const glm::vec3& w) const;
+    float MeanLuminance() const;
+
+private:
+    glm::vec3 radiance;
+};
+
+/*
+    Environment map in the latitude-longitude layout: the
+    rows of the image go from straight up (-y in the model)
+    to straight down, and the columns once around the up
+    axis, starting at +x and turning towards +z. Directions
+    are sampled in proportion to the luminance of the pixels
+    times the solid angle they cover, so small bright
+    sources like the sun are found by almost every sample
+    that is aimed at them.
+*/
+class ImageEnvironment : public Environment {
+public:
+    // width x height pixels, row by row from the top
+    ImageEnvironment(const std::vector<glm::vec3>& pixels, int width, int height, float scale);
+
+    glm::vec3 Le(const glm::vec3& w) const;
+    glm::vec3 Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const;
+    float Pdf(const glm::vec3& w) const;
+    float MeanLuminance() const { return meanLuminance; }
+
+private:
+    glm::vec3 Lookup(const glm::vec2& uv) const;
+
+    std::vector<glm::vec3> pixels;
+    int width, height;
+    Distribution2D distribution;
+    float meanLuminance;
+};
+
+/*
+    Reads a Radiance RGBE (.hdr) image, flat or run-length
+    encoded. Prints an error and returns false if the file
+    cannot be read.
+*/
+bool LoadRGBE(const std::string& path, std::vector<glm::vec3>& pixels, int& width, int& height);
+
+/*
+    Environment map from the RGBE image at path, with its
+    radiance multiplied by scale, or nullptr if it cannot
+    be read.
+*/
+Environment* LoadEnvironment(const std::string& path, float scale);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <thinlens/light/lightsampler.h>
+
+/*
+    Spatial and directional bounds of a set of emitters:
+    an axis-aligned box around them, a cone around their
+    normals (axis w, half angle theta_o) and their total
+    power. Lambertian emitters emit over a further pi/2
+    around every normal (theta_e).
+*/
+struct LightBounds {
+    glm::vec3 pMin, pMax;
+    glm::vec3 w;
+    float cosTheta_o;
+    float cosTheta_e;
+    float phi;
+
+    LightBounds();
+    explicit LightBounds(const Triangle& triangle);
+
+    glm::vec3 Centroid() const { return 0.5f * (pMin + pMax); }
+
+    /*
+        Conservative estimate of the light arriving at point p
+        on a surface with normal n, from anywhere inside the 
+        bounds (Conty Estevez and Kulla, "Importance Sampling 
+        of Many Lights with Adaptive Tree Splitting").
+    */
+    float Importance(const glm::vec3& p, const glm::vec3& n) const;
+};
+
+LightBounds Union(const LightBounds& a, const LightBounds& b);
+
+/*
+    Chooses lights by walking down a bounding volume hierarchy
+    over the emitters, going left or right with probability
+    proportional to the importance of each child for the
+    shading point. Both choosing a light and evaluating its
+    probability take time logarithmic in the number of lights.
+*/
+class BVHLightSampler : public LightSampler {
+public:
+    explicit BVHLightSampler(const std::vector<Triangle>& triangles);
+
+    int Choose(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const override;
+    float Pmf(const glm::vec3& p, const glm::vec3& n, int light) const override;
+
+private:
+    struct Node {
+        LightBounds bounds;
+        int child1 = 0; // second child of interior nodes; the first one follows the node
+        int light = -1; // light number of leaves, -1 for interior nodes
+    };
+
+    int Build(std::vector<std::pair<int, LightBounds>>& items, int begin, int end, uint64_t bitTrail, int depth);
+
+    std::vector<Node> nodes;
+    std::vector<uint64_t> bitTrails; // path from the root to every light, one bit per level
+};
+
+#endif
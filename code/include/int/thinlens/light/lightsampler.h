@@ -0,0 +1,94 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <thinlens/light/aliastable.h>
+#include <thinlens/scene/triangle.h>
+
+/*
+    A point sampled on an emissive triangle. The pdf is 
+    with respect to area and includes the probability of
+    choosing the triangle.
+*/
+struct LightSample {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 emittance;
+    float pdf;
+    int triangleIndex;
+};
+
+/*
+    Chooses one of the emissive triangles of a scene for
+    next-event estimation at a shading point.
+
+    Lights are numbered 0..NumLights()-1 in the order they
+    appear in the triangle list; LightIndex maps a triangle
+    to its light number (-1 if it does not emit).
+*/
+class LightSampler {
+public:
+    explicit LightSampler(const std::vector<Triangle>& triangles);
+    virtual ~LightSampler();
+
+    int NumLights() const { return int(lights.size()); }
+    int LightIndex(int triangleIndex) const { return lightIndex[triangleIndex]; }
+
+    /*
+        Chooses a light for the shading point p with normal n 
+        and stores the probability of the choice in pmf. 
+        Returns -1 if there is nothing to choose from.
+    */
+    virtual int Choose(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const = 0;
+
+    // probability that Choose picks the given light at p
+    virtual float Pmf(const glm::vec3& p, const glm::vec3& n, int light) const = 0;
+
+    /*
+        Chooses a light and samples a point on it uniformly 
+        by area. Returns false if there are no lights.
+    */
+    bool Sample(const glm::vec3& p, const glm::vec3& n, float uLight, const glm::vec2& uPoint, LightSample& ls) const;
+
+    /*
+        Area density of Sample producing the given point on
+        the given emissive triangle.
+    */
+    float Pdf(const glm::vec3& p, const glm::vec3& n, int triangleIndex) const;
+
+protected:
+    const std::vector<Triangle>& triangles;
+    std::vector<int> lights;     // triangle index of every light
+    std::vector<int> lightIndex; // light number of every triangle
+};
+
+/*
+    Chooses lights with probability proportional to their
+    emitted power (or all with the same probability), from
+    an alias table built once at load time.
+*/
+class PowerLightSampler : public LightSampler {
+public:
+    PowerLightSampler(const std::vector<Triangle>& triangles, bool uniform = false);
+
+    int Choose(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const override;
+    float Pmf(const glm::vec3& p, const glm::vec3& n, int light) const override;
+
+private:
+    AliasTable table;
+};
+
+// power emitted by a one-sided Lambertian emitter, as a scalar
+float LightPower(const Triangle& triangle);
+
+/*
+    Creates the light sampler with the given name ("uniform",
+    "power" or "bvh"); returns nullptr for unknown names.
+*/
+LightSampler* MakeLightSampler(const std::string& name, const std::vector<Triangle>& triangles);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef RESERVOIR_H
+#define RESERVOIR_H
+
+#include <glm/glm.hpp>
+
+#include <thinlens/light/lightsampler.h>
+
+/*
+    Weighted reservoir sampling of light samples, the core
+    of ReSTIR (Bitterli et al., "Spatiotemporal Reservoir 
+    Resampling for Real-Time Ray Tracing with Dynamic Direct
+    Lighting"). Candidates are streamed in with resampling 
+    weights, and the reservoir keeps one of them with 
+    probability proportional to its weight. Once finalized,
+    W is the contribution weight of the kept sample: the 
+    light it brings, times W, estimates the direct light.
+
+    Reservoirs of neighbouring pixels (or of the previous 
+    frame) are merged as if all of their candidates had been
+    streamed in, which is what makes reuse cheap.
+*/
+struct Reservoir {
+    Reservoir() : sample(), weightSum(0), M(0), W(0) {}
+
+    // streams in a candidate with resampling weight w; u in [0, 1)
+    bool Update(const LightSample& candidate, float w, float u);
+
+    /*
+        Streams in the sample of r, standing for all of r's
+        candidates. targetPdf is the target density of that
+        sample for this reservoir's shading point.
+    */
+    bool Merge(const Reservoir& r, float targetPdf, float u);
+
+    // sets W for the kept sample, whose target density here is targetPdf
+    void Finalize(float targetPdf);
+
+    LightSample sample;
+    float weightSum;
+    float M; // candidates seen
+    float W;
+};
+
+/*
+    Light that the sample s reflects off a Lambertian surface
+    at p (normal n facing the viewer), ignoring occlusion.
+*/
+glm::vec3 UnshadowedLight(const glm::vec3& p, const glm::vec3& n, const glm::vec3& albedo, const LightSample& s);
+
+// target density of resampling: the luminance of UnshadowedLight
+float TargetPdf(const glm::vec3& p, const glm::vec3& n, const glm::vec3& albedo, const LightSample& s);
+
+#endif
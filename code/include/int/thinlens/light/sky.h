@@ -0,0 +1,53 @@
+#ifndef SKY_H
+#define SKY_H
+
+#include <glm/glm.hpp>
+
+#include <thinlens/light/environment.h>
+
+/*
+    Clear daylight sky and sun after Preetham et al., "A
+    Practical Analytic Model for Daylight". The sky radiance
+    of the Perez model, for the turbidity and the direction
+    of the sun, is evaluated once into a latitude-longitude
+    table (in the layout of ImageEnvironment), which is then
+    both what Le looks up and what directions are sampled
+    from. Below the horizon, a diffuse ground reflects the
+    light of the sky and the sun.
+
+    The sun is a disc of the angular size it has seen from
+    the earth, much smaller than a pixel of the table, so it
+    is kept out of the table: its radiance is the light of
+    the sun outside the atmosphere, dimmed by the air mass it
+    shines through, and it is sampled uniformly over its
+    cone, chosen over the sky in proportion to its power.
+
+    Radiance is in kcd/m^2 (of luminance) times scale.
+*/
+class SkyEnvironment : public Environment {
+public:
+    /*
+        turbidity from 2 (very clear) to 10 (hazy); the sun
+        elevation above the horizon and its azimuth, in
+        degrees, with azimuth 0 along +x and 90 along +z.
+    */
+    SkyEnvironment(float turbidity, float sunElevation, float sunAzimuth, float scale);
+
+    glm::vec3 Le(const glm::vec3& w) const;
+    glm::vec3 Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const;
+    float Pdf(const glm::vec3& w) const;
+    float MeanLuminance() const;
+
+private:
+    // density of sampling w within the cone of the sun
+    float SunPdf(const glm::vec3& w) const;
+
+    glm::vec3 sunDirection;
+    glm::vec3 sunRadiance;
+    float sunCosMax;       // cosine of the angular radius of the sun
+    float sunSolidAngle;
+    ImageEnvironment sky;
+    float sunProbability;  // of sampling the sun rather than the sky
+};
+
+#endif
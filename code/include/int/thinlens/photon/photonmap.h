@@ -0,0 +1,56 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+    A photon deposited on a diffuse surface: where it landed,
+    the normal of the side it arrived on, and the flux it
+    carries.
+*/
+struct Photon {
+    glm::vec3 p;
+    glm::vec3 n;
+    glm::vec3 power;
+};
+
+/*
+    Photons in a balanced kd-tree that is stored implicitly:
+    the photons of every subtree are a contiguous range whose
+    middle element is the root of the subtree, split along
+    the axis on which the range is widest. The tree needs no
+    pointers, and the photons near each other in space are
+    near each other in memory. Lookups only read, so any
+    number of threads can gather at the same time.
+*/
+class PhotonMap {
+public:
+    static const int MAX_GATHER = 256;
+
+    PhotonMap() {}
+
+    // builds the tree over photons, with up to numThreads threads
+    void Build(std::vector<Photon> photons, int numThreads);
+
+    size_t Size() const { return photons.size(); }
+
+    /*
+        Estimate of the irradiance at p on a surface with
+        normal n: the flux of the k (at most MAX_GATHER)
+        nearest photons within maxDistance that arrived on a
+        surface facing the same way, over the area of the disc
+        they were found in.
+    */
+    glm::vec3 Irradiance(const glm::vec3& p, const glm::vec3& n, int k, float maxDistance) const;
+
+private:
+    void Build(int begin, int end, int numThreads);
+
+    std::vector<Photon> photons;
+    std::vector<uint8_t> axes; // split axis of the subtree rooted at each photon
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+    A bump allocator for short-lived data of the render loop
+    (e.g the vertices of a path): allocations are carved out
+    of large blocks, and Reset makes all of them available 
+    again at once without returning the blocks to the heap. 
+    After the first few samples have grown the arena to its 
+    working size, allocating from it costs a pointer bump.
+
+    Destructors of allocated objects are never run, so only
+    trivially destructible types should be put in an arena.
+    Not thread safe: use one arena per thread.
+*/
+class MemoryArena {
+public:
+    explicit MemoryArena(size_t blockSize = 256 * 1024);
+    ~MemoryArena();
+
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    // 16-byte aligned memory for bytes bytes
+    void* Alloc(size_t bytes);
+
+    // n default-constructed Ts
+    template <typename T>
+    T* Alloc(size_t n) {
+        T* t = static_cast<T*>(Alloc(n * sizeof(T)));
+        for (size_t i = 0; i < n; ++i)
+            new (&t[i]) T();
+        return t;
+    }
+
+    // frees every allocation, keeping the memory for reuse
+    void Reset();
+
+    // bytes held by the arena, in use or not
+    size_t TotalAllocated() const;
+
+private:
+    struct Block {
+        unsigned char* memory;
+        size_t size;
+    };
+
+    size_t blockSize;
+    Block current;
+    size_t currentPos;
+    std::vector<Block> used;
+    std::vector<Block> available;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+    A rectangular block of pixels [x0, x1) x [y0, y1).
+
+    The index is the row-major position of the tile in the
+    grid and does not depend on the order in which tiles are
+    rendered, so it can be used to seed per-tile random
+    numbers reproducibly.
+*/
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+    int index;
+};
+
+/*
+    Scanline: row by row, as the renderer used to do it.
+    Hilbert: along a Hilbert curve, so that tiles handed out
+             one after another (i.e to threads running at the
+             same time) are spatially close and share scene data
+             in the caches.
+    Spiral:  outwards from the centre of the frame, so that the
+             centre converges first in previews.
+*/
+enum class TileOrder {
+    Scanline,
+    Hilbert,
+    Spiral
+};
+
+bool ParseTileOrder(const std::string& name, TileOrder& order);
+
+/*
+    Splits a width x height frame into tiles of (at most)
+    tileSize x tileSize pixels, sorted in the given order.
+*/
+std::vector<Tile> MakeTiles(int width, int height, int tileSize, TileOrder order);
+
+/*
+    Clips tiles to the window [x0, x1) x [y0, y1), dropping
+    those outside it. Order and indices are kept, so pixels
+    inside the window are rendered as in the whole frame.
+*/
+std::vector<Tile> CropTiles(const std::vector<Tile>& tiles, int x0, int y0, int x1, int y1);
+
+/*
+    Hands out the tiles of a pass to worker threads in order.
+*/
+class TileScheduler {
+public:
+    explicit TileScheduler(const std::vector<Tile>& tiles);
+
+    // rewinds to the first tile; not thread safe
+    void Reset();
+
+    // thread safe; returns false once every tile of the pass is taken
+    bool Next(Tile& tile);
+
+    const std::vector<Tile>& Tiles() const { return tiles; }
+
+private:
+    std::vector<Tile> tiles;
+    std::atomic<size_t> next;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef BLUE_NOISE_SAMPLER_H
+#define BLUE_NOISE_SAMPLER_H
+
+#include <vector>
+
+#include <thinlens/sampler/sampler.h>
+
+/*
+    A tileable 64 x 64 blue-noise dither mask: every value in 
+    [0, 1) occurs once, and pixels with similar values are 
+    spread out evenly. Generated once, with Ulichney's 
+    void-and-cluster method, the first time it is needed.
+*/
+class BlueNoiseTile {
+public:
+    static const int SIZE = 64;
+
+    static const BlueNoiseTile& Get();
+
+    // toroidal lookup
+    float operator()(int x, int y) const {
+        return values[(y & (SIZE - 1)) * SIZE + (x & (SIZE - 1))];
+    }
+
+private:
+    BlueNoiseTile();
+
+    std::vector<float> values;
+};
+
+/*
+    Blue-noise dithered sampling (Georgiev and Fajardo 2016):
+    every pixel uses the same Owen-scrambled Sobol points, 
+    shifted (modulo 1) by the blue-noise mask at the pixel. 
+    Each pixel keeps the stratification of Sobol, while the 
+    error of neighbouring pixels is negatively correlated, so 
+    that at low sample counts the noise is pushed towards high 
+    frequencies where it is less visible and easier to filter.
+
+    Every dimension looks up the mask at a different toroidal 
+    offset, so dimensions stay decorrelated.
+*/
+class BlueNoiseSampler : public Sampler {
+public:
+    BlueNoiseSampler(int samplesPerPixel, uint64_t seed);
+
+    float Get1D() override;
+    glm::vec2 Get2D() override;
+    Sampler* Clone() const override;
+
+private:
+    float Shift(float u, int dim) const;
+
+    const BlueNoiseTile& tile;
+};
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HALTON_SAMPLER_H
+#define HALTON_SAMPLER_H
+
+#include <thinlens/sampler/sampler.h>
+
+/*
+    The Halton sequence (dimension d uses the radical inverse
+    in the d-th prime base), Owen-scrambled with a different
+    scramble for every pixel and dimension. Dimensions past
+    the tabulated primes reuse them with other scrambles.
+*/
+class HaltonSampler : public Sampler {
+public:
+    HaltonSampler(int samplesPerPixel, uint64_t seed);
+
+    float Get1D() override;
+    glm::vec2 Get2D() override;
+    Sampler* Clone() const override;
+};
+
+#endif
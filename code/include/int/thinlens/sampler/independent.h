@@ -0,0 +1,23 @@
+#ifndef INDEPENDENT_SAMPLER_H
+#define INDEPENDENT_SAMPLER_H
+
+#include <thinlens/sampler/sampler.h>
+#include <thinlens/sampler/lowdiscrepancy.h>
+
+/*
+    Uniform random numbers without any stratification.
+*/
+class IndependentSampler : public Sampler {
+public:
+    IndependentSampler(int samplesPerPixel, uint64_t seed);
+
+    void SetDimension(int dimension) override;
+    float Get1D() override;
+    glm::vec2 Get2D() override;
+    Sampler* Clone() const override;
+
+private:
+    PCG32 rng;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef LOW_DISCREPANCY_H
+#define LOW_DISCREPANCY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+
+/*
+    Building blocks for the samplers: hashing, a small
+    random number generator and (scrambled) low-discrepancy
+    sequences. Mostly following pbrt-v4 and Burley,
+    "Practical Hash-based Owen Scrambling" (JCGT 2020).
+*/
+
+const float ONE_MINUS_EPSILON = 0.99999994f;
+const float TWO_TO_MINUS_32 = 2.3283064365386963e-10f;
+
+inline uint64_t MixBits(uint64_t v) {
+    v ^= (v >> 31);
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= (v >> 27);
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= (v >> 33);
+    return v;
+}
+
+inline uint64_t Hash(std::initializer_list<uint64_t> values) {
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (uint64_t v : values)
+        h = MixBits(h ^ (v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+    return h;
+}
+
+/*
+    The i-th element of a random permutation of [0, l)
+    selected by p, without storing the permutation
+    (Kensler, "Correlated Multi-Jittered Sampling").
+*/
+inline int PermutationElement(uint32_t i, uint32_t l, uint32_t p) {
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;
+        i *= 0xe170893d;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3f;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+    return (i + p) % l;
+}
+
+/*
+    Minimal PCG32 random number generator (O'Neill), cheap 
+    enough to reseed for every pixel sample.
+*/
+class PCG32 {
+public:
+    PCG32(uint64_t sequence = 0, uint64_t seed = 0x853c49e6748fea9bULL) {
+        SetSequence(sequence, seed);
+    }
+
+    void SetSequence(uint64_t sequence, uint64_t seed) {
+        state = 0;
+        inc = (sequence << 1) | 1;
+        Next();
+        state += seed;
+        Next();
+    }
+
+    uint32_t Next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((~rot + 1) & 31));
+    }
+
+    float Uniform() {
+        return std::min(ONE_MINUS_EPSILON, Next() * TWO_TO_MINUS_32);
+    }
+
+private:
+    uint64_t state, inc;
+};
+
+inline uint32_t ReverseBits32(uint32_t n) {
+    n = (n << 16) | (n >> 16);
+    n = ((n & 0x00ff00ff) << 8) | ((n & 0xff00ff00) >> 8);
+    n = ((n & 0x0f0f0f0f) << 4) | ((n & 0xf0f0f0f0) >> 4);
+    n = ((n & 0x33333333) << 2) | ((n & 0xcccccccc) >> 2);
+    n = ((n & 0x55555555) << 1) | ((n & 0xaaaaaaaa) >> 1);
+    return n;
+}
+
+/*
+    Random permutation of the bits of x that only depends on
+    the less significant bits; applied to bit-reversed values
+    it becomes an Owen scramble (nested uniform scramble).
+*/
+inline uint32_t LaineKarrasPermutation(uint32_t x, uint32_t seed) {
+    x ^= x * 0x3d20adea;
+    x += seed;
+    x *= (seed >> 16) | 1;
+    x ^= x * 0x05526c56;
+    x ^= x * 0x53a22864;
+    return x;
+}
+
+inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed) {
+    return ReverseBits32(LaineKarrasPermutation(ReverseBits32(x), seed));
+}
+
+/*
+    The first two dimensions of the Sobol sequence, as 32-bit
+    fixed point: van der Corput and the dimension generated by
+    the polynomial x + 1.
+*/
+inline uint32_t Sobol32(uint32_t index, int dimension) {
+    if (dimension == 0)
+        return ReverseBits32(index);
+
+    uint32_t x = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+        if (index & 1)
+            x ^= v;
+    }
+    return x;
+}
+
+// radical inverse of a in the given base, with every digit permuted by an Owen scramble
+inline float OwenScrambledRadicalInverse(int base, uint64_t a, uint32_t hash) {
+    float invBase = 1.f / base;
+    float invBaseM = 1;
+    uint64_t reversedDigits = 0;
+    // keep going past the last nonzero digit of a: those digits are scrambled too
+    while (1 - invBaseM < 1) {
+        uint64_t next = a / base;
+        int digitValue = int(a - next * base);
+        uint32_t digitHash = uint32_t(MixBits(hash ^ reversedDigits));
+        digitValue = PermutationElement(digitValue, base, digitHash);
+        reversedDigits = reversedDigits * base + digitValue;
+        invBaseM *= invBase;
+        a = next;
+    }
+    return std::min(invBaseM * reversedDigits, ONE_MINUS_EPSILON);
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+/*
+    A sampler provides the random numbers of one pixel sample
+    as a sequence of dimensions. The renderer gives every use
+    of random numbers its own dimension (pixel jitter, lens 
+    position, each decision at each bounce), which is what 
+    lets low-discrepancy samplers stratify each of them.
+
+    Samples are a pure function of the seed, the pixel, the
+    sample index and the dimension, so renders are reproducible
+    and can be resumed at any sample index.
+
+    Samplers are not thread safe; every thread works with its
+    own Clone().
+*/
+class Sampler {
+public:
+    Sampler(int samplesPerPixel, uint64_t seed);
+    virtual ~Sampler();
+
+    int SamplesPerPixel() const { return samplesPerPixel; }
+
+    // starts sample sampleIndex of pixel (x, y) at the given dimension
+    virtual void StartPixelSample(int x, int y, int sampleIndex, int dimension = 0);
+
+    // continues the current pixel sample at the given dimension
+    virtual void SetDimension(int dimension);
+
+    // the next one or two dimensions, in [0, 1)
+    virtual float Get1D() = 0;
+    virtual glm::vec2 Get2D() = 0;
+
+    virtual Sampler* Clone() const = 0;
+
+protected:
+    int samplesPerPixel;
+    uint64_t seed;
+    int px, py;
+    int sampleIndex;
+    int dimension;
+};
+
+/*
+    Creates the sampler with the given name: "independent", 
+    "stratified", "halton", "sobol" or "bluenoise". Returns
+    nullptr for unknown names.
+*/
+Sampler* MakeSampler(const std::string& name, int samplesPerPixel, uint64_t seed);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef SOBOL_SAMPLER_H
+#define SOBOL_SAMPLER_H
+
+#include <thinlens/sampler/sampler.h>
+
+/*
+    Owen-scrambled Sobol points, padded: every pair of 
+    dimensions is drawn from the first two Sobol dimensions
+    (which form a (0,2)-sequence), with the sample index 
+    shuffled and the values scrambled by hashes of pixel and
+    dimension. This keeps the excellent 2D stratification of
+    Sobol for every pair while decorrelating the pairs, 
+    without tables of direction numbers (Burley 2020).
+*/
+class SobolSampler : public Sampler {
+public:
+    SobolSampler(int samplesPerPixel, uint64_t seed);
+
+    float Get1D() override;
+    glm::vec2 Get2D() override;
+    Sampler* Clone() const override;
+};
+
+#endif
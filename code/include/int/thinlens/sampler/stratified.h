@@ -0,0 +1,25 @@
+#ifndef STRATIFIED_SAMPLER_H
+#define STRATIFIED_SAMPLER_H
+
+#include <thinlens/sampler/sampler.h>
+
+/*
+    Jittered stratification of every dimension (or pair of
+    dimensions) into samplesPerPixel strata. The strata are
+    visited in a different random order for every pixel and
+    dimension, so dimensions are not correlated. Samples past
+    samplesPerPixel start a new round of strata.
+*/
+class StratifiedSampler : public Sampler {
+public:
+    StratifiedSampler(int samplesPerPixel, uint64_t seed);
+
+    float Get1D() override;
+    glm::vec2 Get2D() override;
+    Sampler* Clone() const override;
+
+private:
+    int xStrata, yStrata; // xStrata * yStrata == samplesPerPixel
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+    Indexed triangle mesh: vertex positions that the
+    triangles share, and three 32-bit indices into them per
+    triangle. A closed mesh has about half as many vertices
+    as triangles, so this takes a fraction of the memory of
+    storing three positions with every triangle.
+*/
+struct Mesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices; // three per triangle
+
+    size_t NumTriangles() const { return indices.size() / 3; }
+
+    // axis-aligned box around all positions
+    void Bounds(glm::vec3& pMin, glm::vec3& pMax) const;
+};
+
+/*
+    Reads the vertices and faces of a Wavefront OBJ file into
+    mesh; polygons are split into fans of triangles, and
+    everything else (normals, texture coordinates, groups,
+    materials) is ignored. Prints an error and returns false
+    if the file cannot be read or refers to missing vertices.
+*/
+bool LoadOBJ(const std::string& path, Mesh& mesh);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include <thinlens/scene/mesh.h>
+#include <thinlens/scene/triangle.h>
+
+// How a surface reflects and emits light
+struct Material {
+    glm::vec3 color;     // reflectance
+    glm::vec3 emittance; // emitted radiance, on the side the normal points to
+
+    bool IsEmissive() const { return emittance.x > 0 || emittance.y > 0 || emittance.z > 0; }
+};
+
+/*
+    The triangles of a model laid out for rendering. Vertex
+    positions are stored once and shared: a triangle is three
+    32-bit indices into them, and ray queries descend a
+    bounding volume hierarchy over those index triples, so
+    nothing but the positions, the indices and the tree is
+    touched while tracing. Normals are worked out from the
+    positions of the hit that is finally shaded. Triangles
+    refer to their material by index, and triangles with the
+    same reflectance and emittance share one entry of the
+    table.
+
+    Triangle i of the scene is triangle i of the list it was
+    made from; the triangles of meshes follow, in order.
+*/
+class Scene {
+public:
+    Scene() {}
+    explicit Scene(const std::vector<Triangle>& triangles,
+                   const std::vector<Mesh>& meshes = std::vector<Mesh>(),
+                   const std::vector<Material>& meshMaterials = std::vector<Material>());
+
+    int Size() const { return int(indices.size() / 3); }
+    int NumVertices() const { return int(positions.size()); }
+
+    /*
+        Closest triangle hit by the ray from start along dir
+        (which need not be normalized): its index, the point
+        hit and the distance to it. Returns false if the ray
+        hits nothing.
+    */
+    bool Intersect(const glm::vec3& start, const glm::vec3& dir,
+                   int& index, glm::vec3& position, float& distance) const;
+
+    // true if any triangle blocks the segment between start and end (both excluded)
+    bool Occluded(const glm::vec3& start, const glm::vec3& end) const;
+
+    // true if any triangle blocks the ray from start along dir, which then never leaves the scene
+    bool OccludedRay(const glm::vec3& start, const glm::vec3& dir) const;
+
+    glm::vec3 Normal(int i) const;
+    const Material& GetMaterial(int i) const { return materials[materialIds[i]]; }
+    int NumMaterials() const { return int(materials.size()); }
+
+    float Area(int i) const;
+
+    // axis-aligned box around all triangles
+    void Bounds(glm::vec3& pMin, glm::vec3& pMax) const;
+
+    // bytes taken by the vertices, indices, materials and tree
+    size_t MemoryBytes() const;
+
+private:
+    /*
+        32 bytes. An interior node's first child follows it
+        directly and offset is its second child; a leaf holds
+        count triangles from primitives[offset] on.
+    */
+    struct Node {
+        glm::vec3 pMin;
+        uint32_t offset;
+        glm::vec3 pMax;
+        uint16_t count; // 0 for interior nodes
+        uint16_t axis;  // split axis of interior nodes
+    };
+
+    // true if a triangle is hit at a distance in (0, tMax), in units of dir
+    bool AnyHit(const glm::vec3& start, const glm::vec3& dir, float tMax) const;
+
+    void Build();
+    uint32_t BuildNode(std::vector<glm::vec3>& centroids, std::vector<glm::vec3>& lower,
+                       std::vector<glm::vec3>& upper, uint32_t begin, uint32_t end);
+
+    void Vertices(uint32_t i, glm::vec3& v0, glm::vec3& v1, glm::vec3& v2) const {
+        v0 = positions[indices[3 * i]];
+        v1 = positions[indices[3 * i + 1]];
+        v2 = positions[indices[3 * i + 2]];
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices; // three per triangle
+    std::vector<uint32_t> materialIds;
+    std::vector<Material> materials;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> primitives; // triangle indices in leaf order
+};
+
+#endif
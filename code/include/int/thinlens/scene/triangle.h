@@ -0,0 +1,51 @@
+#ifndef TRIANGLE_H
+#define TRIANGLE_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Used to describe a triangular surface:
+class Triangle
+{
+public:
+	glm::vec3 v0;
+	glm::vec3 v1;
+	glm::vec3 v2;
+	glm::vec3 normal;
+	glm::vec3 color;
+	glm::vec3 emittance; // emitted radiance, on the side the normal points to
+
+	Triangle( glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, glm::vec3 color, glm::vec3 emittance = glm::vec3(0,0,0))
+		: v0(v0), v1(v1), v2(v2), color(color), emittance(emittance)
+	{
+		ComputeNormal();
+	}
+
+	void ComputeNormal()
+	{
+		glm::vec3 e1 = v1-v0;
+		glm::vec3 e2 = v2-v0;
+		normal = glm::normalize( glm::cross( e2, e1 ) );
+	}
+
+	float Area() const
+	{
+		return 0.5f * glm::length( glm::cross( v1-v0, v2-v0 ) );
+	}
+
+	bool IsEmissive() const
+	{
+		return emittance.x > 0 || emittance.y > 0 || emittance.z > 0;
+	}
+
+	// Uniformly distributed point on the triangle, for u in [0,1)^2
+	glm::vec3 SamplePoint( const glm::vec2& u ) const
+	{
+		float su = std::sqrt( u.x );
+		float b0 = 1 - su;
+		float b1 = u.y * su;
+		return b0 * v0 + b1 * v1 + (1 - b0 - b1) * v2;
+	}
+};
+
+#endif
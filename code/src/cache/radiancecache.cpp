@@ -0,0 +1,122 @@
+#include <thinlens/cache/radiancecache.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // slots tried after the one a key hashes to
+    const int MAX_PROBES = 16;
+    // bits per quantized coordinate; the grid wraps around beyond that
+    const int COORDINATE_BITS = 20;
+
+    uint64_t MixBits(uint64_t v) {
+        v ^= v >> 31;
+        v *= 0x7fb5d329728ea185ULL;
+        v ^= v >> 27;
+        v *= 0x81dadef4bc2dd44dULL;
+        v ^= v >> 33;
+        return v;
+    }
+
+    void AtomicAdd(std::atomic<float>& a, float v) {
+        float old = a.load(std::memory_order_relaxed);
+        while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed))
+            ;
+    }
+};
+
+RadianceCache::Entry::Entry() : key(0), count(0) {
+    for (int c = 0; c < 3; ++c)
+        sum[c].store(0, std::memory_order_relaxed);
+}
+
+RadianceCache::RadianceCache(float cellSize, size_t memoryBytes)
+    : cellSize(cellSize), cells(0)
+{
+    size_t capacity = 1;
+    while (capacity * 2 * sizeof(Entry) <= memoryBytes)
+        capacity *= 2;
+    std::vector<Entry>(capacity).swap(entries);
+}
+
+uint64_t RadianceCache::Key(const glm::vec3& p, const glm::vec3& n) const {
+    const uint64_t mask = (uint64_t(1) << COORDINATE_BITS) - 1;
+    uint64_t key = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        int64_t cell = int64_t(std::floor(p[axis] / cellSize));
+        key = (key << COORDINATE_BITS) | (uint64_t(cell) & mask);
+    }
+
+    // the axis closest to the normal, and which way along it
+    glm::vec3 a = glm::abs(n);
+    int axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    int direction = 2 * axis + (n[axis] < 0);
+
+    // never 0, which marks empty slots
+    return (key << 3 | direction) | (uint64_t(1) << 63);
+}
+
+long RadianceCache::Find(uint64_t key, bool insert) {
+    size_t mask = entries.size() - 1;
+    size_t slot = MixBits(key) & mask;
+    for (int probe = 0; probe <= MAX_PROBES; ++probe, slot = (slot + 1) & mask) {
+        uint64_t stored = entries[slot].key.load(std::memory_order_relaxed);
+        if (stored == key)
+            return slot;
+        if (stored == 0 && insert) {
+            // another thread may claim the slot first, perhaps for the same key
+            if (entries[slot].key.compare_exchange_strong(stored, key, std::memory_order_relaxed)) {
+                cells.fetch_add(1, std::memory_order_relaxed);
+                return slot;
+            }
+            if (stored == key)
+                return slot;
+        }
+    }
+    return -1;
+}
+
+long RadianceCache::Find(uint64_t key) const {
+    size_t mask = entries.size() - 1;
+    size_t slot = MixBits(key) & mask;
+    for (int probe = 0; probe <= MAX_PROBES; ++probe, slot = (slot + 1) & mask) {
+        uint64_t stored = entries[slot].key.load(std::memory_order_relaxed);
+        if (stored == key)
+            return slot;
+        if (stored == 0)
+            return -1;
+    }
+    return -1;
+}
+
+void RadianceCache::Add(const glm::vec3& p, const glm::vec3& n, const glm::vec3& radiance) {
+    if (!(radiance.r >= 0 && radiance.g >= 0 && radiance.b >= 0) || std::isinf(radiance.r + radiance.g + radiance.b))
+        return;
+
+    long slot = Find(Key(p, n), true);
+    if (slot < 0)
+        return;
+
+    Entry& entry = entries[slot];
+    for (int c = 0; c < 3; ++c)
+        AtomicAdd(entry.sum[c], radiance[c]);
+    entry.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool RadianceCache::Lookup(const glm::vec3& p, const glm::vec3& n, uint32_t minSamples, glm::vec3& radiance) const {
+    long slot = Find(Key(p, n));
+    if (slot < 0)
+        return false;
+
+    const Entry& entry = entries[slot];
+    uint32_t count = entry.count.load(std::memory_order_relaxed);
+    if (count < std::max(1u, minSamples))
+        return false;
+
+    // sums and count are updated separately, so this may be off by
+    // a sample that is being added right now
+    radiance = glm::vec3(entry.sum[0].load(std::memory_order_relaxed),
+                         entry.sum[1].load(std::memory_order_relaxed),
+                         entry.sum[2].load(std::memory_order_relaxed)) / float(count);
+    return true;
+}
@@ -3,12 +3,12 @@
 Camera::Camera(const mat4& cameraToWorld, 
             float shutterOpen, 
             float shutterClose, 
-            const bitmap_image& film): cameraToWorld(cameraToWorld),
+            const Film& film): cameraToWorld(cameraToWorld),
                                 shutterOpen(shutterOpen),
                                 shutterClose(shutterClose),
                                 film(film) {}
 
-float Camera::GenerateRayDifferential(const CameraSample& sample, RayDifferential& rd) {
+float Camera::GenerateRayDifferential(const CameraSample& sample, RayDifferential& rd) {
     float wt = GenerateRay(sample, rd);
     CameraSample sshift = sample;
     sshift.pFilm.x++;
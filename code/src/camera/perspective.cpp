@@ -1,6 +1,6 @@
 #include <thinlens/camera/perspective.h>
 
-#include <bmp/bmp.h>
+#include <thinlens/film/film.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -57,7 +57,7 @@ PerspectiveCamera::PerspectiveCamera(
     const mat4 &cameraToWorld, const mat2& screenWindow,
     float shutterOpen, float shutterClose, 
     float lensr, float focald, float fovy,
-    const bitmap_image& film
+    const Film& film
 ): ProjectiveCamera(
     cameraToWorld, 
     Perspective(focald, screenWindow[1][1], 1e-2f, 1000.f), 
@@ -69,6 +69,18 @@ PerspectiveCamera::PerspectiveCamera(
     vec4 y1 = rasterToCamera * vec4(0,0,0,1); y1 /= y1.w;
     dxCamera = x2 - x1; dxCamera.w = 0;
     dyCamera = y2 - y1; dyCamera.w = 0;
+
+    worldToCamera = glm::inverse(cameraToWorld);
+    cameraToRaster = glm::inverse(rasterToCamera);
+
+    vec4 pMin = rasterToCamera * vec4(0, 0, 0, 1); pMin /= pMin.w;
+    vec4 pMax = rasterToCamera * vec4(film.Width(), film.Height(), 0, 1); pMax /= pMax.w;
+    pMin /= pMin.z;
+    pMax /= pMax.z;
+    imageArea = std::abs((pMax.x - pMin.x) * (pMax.y - pMin.y));
+
+    // a pinhole is treated as a lens of unit area
+    lensArea = lensRadius > 0 ? PI * lensRadius * lensRadius : 1;
 }
 
 float PerspectiveCamera::GenerateRay(const CameraSample& sample, Ray& ray) const {
@@ -112,3 +124,65 @@ float PerspectiveCamera::GenerateRay(const CameraSample& sample, Ray& ray) const
     return 1;
 }
 
+float PerspectiveCamera::FilmCosine(const Ray& ray, vec2& pRaster) const {
+    vec4 o = worldToCamera * vec4(vec3(ray.o), 1);
+    vec4 d = worldToCamera * vec4(glm::normalize(vec3(ray.d)), 0);
+    float cosTheta = d.z;
+    if (cosTheta <= 0)
+        return 0;
+
+    // rays through the same point of the focal plane come from the same
+    // point of the film, as in GenerateRay
+    float focus = lensRadius > 0 ? focalDistance : 1;
+    vec4 pFocus = o + d * (focus / cosTheta);
+    vec4 r = cameraToRaster * vec4(pFocus.x, pFocus.y, pFocus.z, 1);
+    pRaster = vec2(r.x / r.w, r.y / r.w);
+
+    if (pRaster.x < 0 || pRaster.x >= film.Width() || pRaster.y < 0 || pRaster.y >= film.Height())
+        return 0;
+    return cosTheta;
+}
+
+float PerspectiveCamera::We(const Ray& ray, vec2& pRaster) const {
+    float cosTheta = FilmCosine(ray, pRaster);
+    if (cosTheta == 0)
+        return 0;
+
+    float cos2Theta = cosTheta * cosTheta;
+    return 1 / (imageArea * lensArea * cos2Theta * cos2Theta);
+}
+
+void PerspectiveCamera::PdfWe(const Ray& ray, float& pdfPos, float& pdfDir) const {
+    vec2 pRaster;
+    float cosTheta = FilmCosine(ray, pRaster);
+    if (cosTheta == 0) {
+        pdfPos = pdfDir = 0;
+        return;
+    }
+
+    pdfPos = 1 / lensArea;
+    pdfDir = 1 / (imageArea * cosTheta * cosTheta * cosTheta);
+}
+
+float PerspectiveCamera::SampleWi(const vec3& p, const vec2& u, vec3& wi,
+                                  vec3& pLens, float& pdf, vec2& pRaster) const {
+    vec2 pLensCamera = lensRadius * ConcentricSampleDisk(u);
+    pLens = vec3(cameraToWorld * vec4(pLensCamera.x, pLensCamera.y, 0, 1));
+    vec3 lensNormal = glm::normalize(vec3(cameraToWorld * vec4(0, 0, 1, 0)));
+
+    wi = pLens - p;
+    float dist = glm::length(wi);
+    wi /= dist;
+
+    float cosLens = std::abs(glm::dot(lensNormal, wi));
+    if (cosLens == 0) {
+        pdf = 0;
+        return 0;
+    }
+    pdf = dist * dist / (cosLens * lensArea);
+
+    Ray ray;
+    ray.o = vec4(pLens, 1);
+    ray.d = vec4(-wi, 0);
+    return We(ray, pRaster);
+}
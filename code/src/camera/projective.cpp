@@ -11,7 +11,7 @@ using namespace glm;
 ProjectiveCamera::ProjectiveCamera(const mat4 &cameraToWorld, 
                const mat4 &cameraToScreen, const mat2& screenWindow,
                float shutterOpen, float shutterClose, float lensr, float focald,
-               const bitmap_image& film): 
+               const Film& film): 
                 Camera(cameraToWorld, shutterOpen, shutterClose, film),
                 cameraToScreen(cameraToScreen),
                 lensRadius(lensr), focalDistance(focald) {
@@ -20,7 +20,7 @@ ProjectiveCamera::ProjectiveCamera(const mat4 &cameraToWorld,
                     mat4 m2 = glm::scale(mat4(), vec3(1.f / screenWindow[1][0], 1.f / screenWindow[1][1], 1));
 
                     // [2]
-                    mat4 m3 = glm::scale(mat4(), vec3(film.width(), film.height(), 1));
+                    mat4 m3 = glm::scale(mat4(), vec3(film.Width(), film.Height(), 1));
                     screenToRaster = m3 * m2 * m1;
 
                     rasterToScreen = glm::inverse(screenToRaster);
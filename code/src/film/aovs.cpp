@@ -0,0 +1,64 @@
+#include <thinlens/film/aovs.h>
+
+#include <algorithm>
+
+namespace {
+    unsigned char ToByte(float c) {
+        return (unsigned char)(std::min(std::max(255.f * c, 0.f), 255.f));
+    }
+};
+
+AOVBuffer::AOVBuffer(int width, int height) : width(width), height(height),
+    ar(size_t(width) * height), ag(size_t(width) * height), ab(size_t(width) * height),
+    nx(size_t(width) * height), ny(size_t(width) * height), nz(size_t(width) * height),
+    z(size_t(width) * height), n(size_t(width) * height) {}
+
+glm::vec3 AOVBuffer::Albedo(int x, int y) const {
+    size_t i = size_t(y) * width + x;
+    if (n[i] == 0)
+        return glm::vec3(0, 0, 0);
+    return glm::vec3(ar[i], ag[i], ab[i]) / n[i];
+}
+
+glm::vec3 AOVBuffer::Normal(int x, int y) const {
+    size_t i = size_t(y) * width + x;
+    glm::vec3 normal(nx[i], ny[i], nz[i]);
+    float length = glm::length(normal);
+    if (length == 0)
+        return normal;
+    return normal / length;
+}
+
+float AOVBuffer::Depth(int x, int y) const {
+    size_t i = size_t(y) * width + x;
+    if (n[i] == 0)
+        return 0;
+    return z[i] / n[i];
+}
+
+void AOVBuffer::ResolveAlbedo(bitmap_image& image) const {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            glm::vec3 a = Albedo(x, y);
+            image.set_pixel(x, y, ToByte(a.r), ToByte(a.g), ToByte(a.b));
+        }
+    }
+}
+
+void AOVBuffer::ResolveNormal(bitmap_image& image) const {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            glm::vec3 c = 0.5f * Normal(x, y) + 0.5f;
+            image.set_pixel(x, y, ToByte(c.r), ToByte(c.g), ToByte(c.b));
+        }
+    }
+}
+
+void AOVBuffer::ResolveDepth(float maxDepth, bitmap_image& image) const {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned char c = ToByte(1 - Depth(x, y) / maxDepth);
+            image.set_pixel(x, y, c, c, c);
+        }
+    }
+}
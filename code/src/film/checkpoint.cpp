@@ -0,0 +1,228 @@
+#include <thinlens/film/checkpoint.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const char MAGIC[8] = {'T', 'L', 'C', 'K', 'P', 'T', 0, 0};
+    const uint32_t VERSION = 1;
+    const uint32_t NO_SLOT = 0xFFFFFFFF;
+    // large enough to be a multiple of the page size on every platform we
+    // run on, so that every slot can be msync'ed on its own
+    const size_t PAGE = 1 << 16;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t active; // slot holding the latest complete snapshot
+        uint32_t pad;
+        uint64_t sequence;
+    };
+
+    struct SlotHeader {
+        uint64_t samples;
+        uint64_t seed;
+        uint64_t sequence;
+    };
+
+    size_t RoundToPage(size_t n) {
+        return (n + PAGE - 1) / PAGE * PAGE;
+    }
+
+    size_t SlotSize(int width, int height, int channels) {
+        return RoundToPage(sizeof(SlotHeader) + sizeof(float) * size_t(width) * height * channels);
+    }
+};
+
+bool LoadCheckpoint(const std::string& path, CheckpointData& data) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "could not open checkpoint " << path << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < PAGE) {
+        std::cerr << "checkpoint " << path << " is truncated" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        std::cerr << "could not map checkpoint " << path << std::endl;
+        return false;
+    }
+
+    const unsigned char* base = static_cast<const unsigned char*>(m);
+    FileHeader header;
+    std::memcpy(&header, base, sizeof(header));
+
+    bool ok = false;
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+        std::cerr << path << " is not a checkpoint of this version" << std::endl;
+    } else if (header.active == NO_SLOT) {
+        std::cerr << "checkpoint " << path << " holds no snapshot yet" << std::endl;
+    } else {
+        size_t slotSize = SlotSize(header.width, header.height, header.channels);
+        if (size_t(st.st_size) < PAGE + 2 * slotSize || header.active > 1) {
+            std::cerr << "checkpoint " << path << " is truncated" << std::endl;
+        } else {
+            const unsigned char* slot = base + PAGE + header.active * slotSize;
+            SlotHeader sh;
+            std::memcpy(&sh, slot, sizeof(sh));
+
+            data.width = header.width;
+            data.height = header.height;
+            data.channels = header.channels;
+            data.samples = sh.samples;
+            data.seed = sh.seed;
+            data.pixels.resize(size_t(header.width) * header.height * header.channels);
+            std::memcpy(data.pixels.data(), slot + sizeof(SlotHeader), data.pixels.size() * sizeof(float));
+            ok = true;
+        }
+    }
+
+    munmap(m, st.st_size);
+    return ok;
+}
+
+CheckpointWriter::CheckpointWriter(const std::string& path, int width, int height, int channels)
+    : width(width), height(height), channels(channels),
+      slotSize(SlotSize(width, height, channels)),
+      fileSize(PAGE + 2 * SlotSize(width, height, channels)),
+      mapping(nullptr), pendingSamples(0), pendingSeed(0),
+      hasPending(false), writing(false), done(false)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "could not open checkpoint " << path << " for writing" << std::endl;
+        return;
+    }
+
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || size_t(st.st_size) != fileSize;
+    if (fresh && ftruncate(fd, fileSize) != 0) {
+        std::cerr << "could not resize checkpoint " << path << std::endl;
+        close(fd);
+        return;
+    }
+
+    void* m = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        std::cerr << "could not map checkpoint " << path << std::endl;
+        return;
+    }
+    mapping = static_cast<unsigned char*>(m);
+
+    // keep the existing snapshot when reopening a matching file (resume)
+    FileHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    if (fresh || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+        || header.width != uint32_t(width) || header.height != uint32_t(height)
+        || header.channels != uint32_t(channels)) {
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.width = width;
+        header.height = height;
+        header.channels = channels;
+        header.active = NO_SLOT;
+        std::memcpy(mapping, &header, sizeof(header));
+        msync(mapping, PAGE, MS_SYNC);
+    }
+
+    worker = std::thread(&CheckpointWriter::Run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    if (mapping == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    cv.notify_all();
+    worker.join();
+    munmap(mapping, fileSize);
+}
+
+void CheckpointWriter::Submit(const std::vector<float>& pixels, uint64_t samples, uint64_t seed) {
+    if (mapping == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = pixels;
+        pendingSamples = samples;
+        pendingSeed = seed;
+        hasPending = true;
+    }
+    cv.notify_all();
+}
+
+void CheckpointWriter::Flush() {
+    if (mapping == nullptr)
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this] { return !hasPending && !writing; });
+}
+
+void CheckpointWriter::Run() {
+    std::vector<float> pixels;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        cv.wait(lock, [this] { return hasPending || done; });
+        if (!hasPending)
+            return;
+
+        pixels.swap(pending);
+        uint64_t samples = pendingSamples;
+        uint64_t seed = pendingSeed;
+        hasPending = false;
+        writing = true;
+
+        lock.unlock();
+        WriteSlot(pixels, samples, seed);
+        lock.lock();
+
+        writing = false;
+        cv.notify_all();
+    }
+}
+
+void CheckpointWriter::WriteSlot(const std::vector<float>& pixels, uint64_t samples, uint64_t seed) {
+    FileHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+
+    uint32_t target = header.active == 0 ? 1 : 0;
+    unsigned char* slot = mapping + PAGE + target * slotSize;
+
+    SlotHeader sh;
+    sh.samples = samples;
+    sh.seed = seed;
+    sh.sequence = header.sequence + 1;
+    std::memcpy(slot, &sh, sizeof(sh));
+    std::memcpy(slot + sizeof(SlotHeader), pixels.data(),
+                std::min(pixels.size(), size_t(width) * height * channels) * sizeof(float));
+    msync(slot, slotSize, MS_SYNC);
+
+    // only flip to the new slot once it is completely on disk
+    header.active = target;
+    header.sequence = sh.sequence;
+    std::memcpy(mapping, &header, sizeof(header));
+    msync(mapping, PAGE, MS_SYNC);
+}
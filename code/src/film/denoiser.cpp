@@ -0,0 +1,150 @@
+#include <thinlens/film/denoiser.h>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+    const float KERNEL[5] = {1 / 16.f, 1 / 4.f, 3 / 8.f, 1 / 4.f, 1 / 16.f};
+
+    // keeps black surfaces from blowing up the demodulated radiance
+    const float MIN_ALBEDO = 0.01f;
+
+    float Luminance(const glm::vec3& c) {
+        return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+    }
+
+    /*
+        3x3 Gaussian of the variance around a pixel: estimates
+        from a few samples are noisy themselves, and a pixel 
+        whose samples happened to agree would otherwise not 
+        be filtered at all.
+    */
+    float BlurredVariance(const std::vector<float>& variance, int width, int height, int x, int y) {
+        const float weights[3] = {1 / 4.f, 1 / 2.f, 1 / 4.f};
+        float sum = 0, sumWeight = 0;
+        for (int j = -1; j <= 1; ++j) {
+            for (int i = -1; i <= 1; ++i) {
+                int qx = x + i, qy = y + j;
+                if (qx < 0 || qx >= width || qy < 0 || qy >= height)
+                    continue;
+                float w = weights[i + 1] * weights[j + 1];
+                sum += w * variance[size_t(qy) * width + qx];
+                sumWeight += w;
+            }
+        }
+        return sum / sumWeight;
+    }
+
+    struct Guides {
+        int width, height;
+        std::vector<glm::vec3> normal;
+        std::vector<float> depth;
+    };
+
+    /*
+        One a-trous iteration with the given gap between taps,
+        over the rows y0, y0 + rowStep, ...
+    */
+    void FilterRows(const Guides& guides, const DenoiseSettings& settings, int gap,
+                    const std::vector<glm::vec3>& color, const std::vector<float>& variance,
+                    std::vector<glm::vec3>& colorOut, std::vector<float>& varianceOut,
+                    int y0, int rowStep) {
+        int width = guides.width, height = guides.height;
+
+        for (int y = y0; y < height; y += rowStep) {
+            for (int x = 0; x < width; ++x) {
+                size_t p = size_t(y) * width + x;
+                float lp = Luminance(color[p]);
+                float sigmaL = settings.sigmaLuminance * std::sqrt(BlurredVariance(variance, width, height, x, y)) + 1e-6f;
+                float sigmaZ = settings.sigmaDepth * gap;
+
+                glm::vec3 sumColor(0, 0, 0);
+                float sumWeight = 0;
+                float sumVariance = 0;
+                for (int j = -2; j <= 2; ++j) {
+                    int qy = y + j * gap;
+                    if (qy < 0 || qy >= height)
+                        continue;
+                    for (int i = -2; i <= 2; ++i) {
+                        int qx = x + i * gap;
+                        if (qx < 0 || qx >= width)
+                            continue;
+                        size_t q = size_t(qy) * width + qx;
+
+                        float wL = std::abs(lp - Luminance(color[q])) / sigmaL;
+                        float wZ = std::abs(guides.depth[p] - guides.depth[q]) / sigmaZ;
+                        float wN = std::pow(std::max(0.f, glm::dot(guides.normal[p], guides.normal[q])), settings.normalExponent);
+                        float w = KERNEL[i + 2] * KERNEL[j + 2] * wN * std::exp(-wL - wZ);
+
+                        sumColor += w * color[q];
+                        sumWeight += w;
+                        sumVariance += w * w * variance[q];
+                    }
+                }
+
+                // the centre tap always has weight, unless its normal is zero
+                if (sumWeight > 0) {
+                    colorOut[p] = sumColor / sumWeight;
+                    varianceOut[p] = sumVariance / (sumWeight * sumWeight);
+                } else {
+                    colorOut[p] = color[p];
+                    varianceOut[p] = variance[p];
+                }
+            }
+        }
+    }
+};
+
+Film Denoise(const Film& film, const AOVBuffer& aovs, const DenoiseSettings& settings, int numThreads) {
+    int width = film.Width(), height = film.Height();
+    size_t n = size_t(width) * height;
+
+    Guides guides;
+    guides.width = width;
+    guides.height = height;
+    guides.normal.resize(n);
+    guides.depth.resize(n);
+
+    std::vector<glm::vec3> albedo(n);
+    std::vector<glm::vec3> color(n), colorOut(n);
+    std::vector<float> variance(n), varianceOut(n);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t p = size_t(y) * width + x;
+            albedo[p] = glm::max(aovs.Albedo(x, y), glm::vec3(MIN_ALBEDO));
+            guides.normal[p] = aovs.Normal(x, y);
+            guides.depth[p] = aovs.Depth(x, y);
+
+            float a = Luminance(albedo[p]);
+            color[p] = film.Pixel(x, y) / albedo[p];
+            variance[p] = film.Variance(x, y) / (a * a);
+        }
+    }
+
+    numThreads = std::max(1, std::min(numThreads, height));
+    for (int it = 0; it < settings.iterations; ++it) {
+        int gap = 1 << it;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < numThreads; ++t) {
+            workers.push_back(std::thread(FilterRows, std::cref(guides), std::cref(settings), gap,
+                                          std::cref(color), std::cref(variance),
+                                          std::ref(colorOut), std::ref(varianceOut), t, numThreads));
+        }
+        for (std::thread& w : workers)
+            w.join();
+
+        color.swap(colorOut);
+        variance.swap(varianceOut);
+    }
+
+    Film result(width, height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t p = size_t(y) * width + x;
+            result.AddSample(x, y, color[p] * albedo[p]);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,425 @@
+#include <thinlens/film/film.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+    const int SRGB_TABLE_SIZE = 4096;
+
+    // luminance below which errors are no longer measured relative to the pixel
+    const float ERROR_FLOOR = 0.05f;
+
+    /*
+        8-bit sRGB encoding of [0, 1] linear values, tabulated
+        so that the resolve does not call pow per channel.
+    */
+    struct SRGBTable {
+        unsigned char value[SRGB_TABLE_SIZE + 1];
+
+        SRGBTable() {
+            for (int i = 0; i <= SRGB_TABLE_SIZE; ++i) {
+                float c = float(i) / SRGB_TABLE_SIZE;
+                float e = c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1 / 2.4f) - 0.055f;
+                value[i] = (unsigned char)(255.f * e + 0.5f);
+            }
+        }
+    };
+
+    const SRGBTable srgbTable;
+
+    void ApplyToneMap(ToneMap toneMap, float* c, int n) {
+        switch (toneMap) {
+        case ToneMap::None:
+            break;
+        case ToneMap::Reinhard:
+            for (int i = 0; i < n; ++i)
+                c[i] = c[i] / (1 + c[i]);
+            break;
+        case ToneMap::ACES:
+            // fit of the ACES filmic curve by Krzysztof Narkowicz
+            for (int i = 0; i < n; ++i)
+                c[i] = (c[i] * (2.51f * c[i] + 0.03f)) / (c[i] * (2.43f * c[i] + 0.59f) + 0.14f);
+            break;
+        }
+    }
+
+    void Quantize(bool srgb, const float* c, unsigned char* q, int n) {
+        if (srgb) {
+            for (int i = 0; i < n; ++i)
+                q[i] = srgbTable.value[int(std::min(std::max(c[i], 0.f), 1.f) * SRGB_TABLE_SIZE)];
+        } else {
+            for (int i = 0; i < n; ++i)
+                q[i] = (unsigned char)(std::min(std::max(255.f * c[i], 0.f), 255.f));
+        }
+    }
+};
+
+bool ParseToneMap(const std::string& name, ToneMap& toneMap) {
+    if (name == "none") {
+        toneMap = ToneMap::None;
+    } else if (name == "reinhard") {
+        toneMap = ToneMap::Reinhard;
+    } else if (name == "aces") {
+        toneMap = ToneMap::ACES;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ParseResolution(const std::string& text, int& width, int& height) {
+    std::istringstream in(text);
+    char separator;
+    int w, h;
+    if (!(in >> w >> separator >> h) || separator != 'x' || !in.eof() || w < 1 || h < 1)
+        return false;
+    width = w;
+    height = h;
+    return true;
+}
+
+bool ParseCropWindow(const std::string& text, CropWindow& crop) {
+    std::istringstream in(text);
+    char c0, c1, c2;
+    CropWindow window;
+    if (!(in >> window.x0 >> c0 >> window.y0 >> c1 >> window.x1 >> c2 >> window.y1) || !in.eof())
+        return false;
+    if (c0 != ',' || c1 != ',' || c2 != ',' || window.x0 < 0 || window.y0 < 0
+        || window.x1 <= window.x0 || window.y1 <= window.y0)
+        return false;
+    crop = window;
+    return true;
+}
+
+Film::Film(int width, int height, int buckets, const Filter& filter) : width(width), height(height),
+    buckets(std::min(std::max(buckets, 1), MAX_BUCKETS)), filter(filter),
+    r(size_t(width) * height), g(size_t(width) * height),
+    b(size_t(width) * height), w(size_t(width) * height),
+    count(size_t(width) * height), lumMean(size_t(width) * height),
+    lumM2(size_t(width) * height), splatR(size_t(width) * height),
+    splatG(size_t(width) * height), splatB(size_t(width) * height),
+    splatWeight(0)
+{
+    if (this->buckets > 1) {
+        size_t n = size_t(width) * height * this->buckets;
+        bucketR.resize(n);
+        bucketG.resize(n);
+        bucketB.resize(n);
+        bucketW.resize(n);
+    }
+}
+
+glm::vec3 Film::Pixel(int x, int y) const {
+    size_t i = size_t(y) * width + x;
+    glm::vec3 L(0, 0, 0);
+    if (w[i] > 0)
+        L = buckets > 1 ? MedianOfMeans(i) : glm::vec3(r[i], g[i], b[i]) / w[i];
+    if (splatWeight > 0)
+        L += glm::vec3(splatR[i], splatG[i], splatB[i]) / splatWeight;
+    return L;
+}
+
+glm::vec3 Film::MedianOfMeans(size_t i) const {
+    // means of the buckets that have samples, sorted by luminance
+    glm::vec3 means[MAX_BUCKETS];
+    float lum[MAX_BUCKETS];
+    int n = 0;
+    for (int k = 0; k < buckets; ++k) {
+        size_t j = k * r.size() + i;
+        if (bucketW[j] == 0)
+            continue;
+        glm::vec3 m = glm::vec3(bucketR[j], bucketG[j], bucketB[j]) / bucketW[j];
+        float l = 0.2126f * m.r + 0.7152f * m.g + 0.0722f * m.b;
+        int pos = n++;
+        for (; pos > 0 && lum[pos - 1] > l; --pos) {
+            means[pos] = means[pos - 1];
+            lum[pos] = lum[pos - 1];
+        }
+        means[pos] = m;
+        lum[pos] = l;
+    }
+
+    if (n == 0)
+        return glm::vec3(0, 0, 0);
+    if (n % 2 == 1)
+        return means[n / 2];
+    return 0.5f * (means[n / 2 - 1] + means[n / 2]);
+}
+
+float Film::Variance(int x, int y) const {
+    size_t i = size_t(y) * width + x;
+    if (count[i] < 2)
+        return 0;
+    return lumM2[i] / (count[i] - 1) / count[i];
+}
+
+float Film::RelativeError(int x, int y) const {
+    size_t i = size_t(y) * width + x;
+    if (count[i] < 2)
+        return std::numeric_limits<float>::infinity();
+    return std::sqrt(Variance(x, y)) / std::max(lumMean[i], ERROR_FLOOR);
+}
+
+glm::vec3 Film::Mean() const {
+    double sr = 0, sg = 0, sb = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < w.size(); ++i) {
+        if (w[i] > 0) {
+            glm::vec3 L = Pixel(int(i % width), int(i / width));
+            sr += L.r;
+            sg += L.g;
+            sb += L.b;
+            ++n;
+        }
+    }
+    if (n == 0)
+        return glm::vec3(0, 0, 0);
+    return glm::vec3(sr / n, sg / n, sb / n);
+}
+
+int Film::MinSampleCount(const CropWindow& window) const {
+    float least = std::numeric_limits<float>::max();
+    for (int y = window.y0; y < window.y1; ++y)
+        for (int x = window.x0; x < window.x1; ++x)
+            least = std::min(least, count[size_t(y) * width + x]);
+    return window.x0 < window.x1 && window.y0 < window.y1 ? int(least) : 0;
+}
+
+void Film::Merge(const Film& other) {
+    for (size_t i = 0; i < w.size(); ++i) {
+        r[i] += other.r[i];
+        g[i] += other.g[i];
+        b[i] += other.b[i];
+        w[i] += other.w[i];
+
+        // Chan et al.'s combination of two sets of Welford statistics
+        float n = count[i] + other.count[i];
+        if (n > 0) {
+            float delta = other.lumMean[i] - lumMean[i];
+            lumM2[i] += other.lumM2[i] + delta * delta * count[i] * other.count[i] / n;
+            lumMean[i] += delta * other.count[i] / n;
+            count[i] = n;
+        }
+    }
+
+    for (size_t i = 0; i < w.size(); ++i) {
+        splatR[i] += other.splatR[i];
+        splatG[i] += other.splatG[i];
+        splatB[i] += other.splatB[i];
+    }
+    splatWeight += other.splatWeight;
+
+    // empty unless both films have the same number of buckets
+    for (size_t j = 0; j < bucketW.size() && j < other.bucketW.size(); ++j) {
+        bucketR[j] += other.bucketR[j];
+        bucketG[j] += other.bucketG[j];
+        bucketB[j] += other.bucketB[j];
+        bucketW[j] += other.bucketW[j];
+    }
+}
+
+void Film::MergeTile(const FilmTile& tile) {
+    int tileWidth = tile.x1 - tile.x0;
+    size_t tileSize = tile.w.size();
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        size_t row = size_t(y) * width + tile.x0;
+        size_t tileRow = size_t(y - tile.y0) * tileWidth;
+        for (int x = 0; x < tileWidth; ++x) {
+            r[row + x] += tile.r[tileRow + x];
+            g[row + x] += tile.g[tileRow + x];
+            b[row + x] += tile.b[tileRow + x];
+            w[row + x] += tile.w[tileRow + x];
+        }
+        if (buckets == 1)
+            continue;
+        for (int k = 0; k < buckets; ++k) {
+            size_t j = k * r.size() + row;
+            size_t t = k * tileSize + tileRow;
+            for (int x = 0; x < tileWidth; ++x) {
+                bucketR[j + x] += tile.bucketR[t + x];
+                bucketG[j + x] += tile.bucketG[t + x];
+                bucketB[j + x] += tile.bucketB[t + x];
+                bucketW[j + x] += tile.bucketW[t + x];
+            }
+        }
+    }
+}
+
+void Film::Resolve(const ResolveSettings& settings, bitmap_image& image) const {
+    std::vector<float> scale(width), cr(width), cg(width), cb(width);
+    std::vector<unsigned char> qr(width), qg(width), qb(width);
+
+    for (int y = 0; y < height; ++y) {
+        size_t row = size_t(y) * width;
+
+        if (buckets > 1) {
+            for (int x = 0; x < width; ++x) {
+                glm::vec3 c = settings.exposure * Pixel(x, y);
+                cr[x] = c.r;
+                cg[x] = c.g;
+                cb[x] = c.b;
+            }
+        } else {
+            for (int x = 0; x < width; ++x)
+                scale[x] = w[row + x] > 0 ? settings.exposure / w[row + x] : 0;
+            for (int x = 0; x < width; ++x) {
+                cr[x] = r[row + x] * scale[x];
+                cg[x] = g[row + x] * scale[x];
+                cb[x] = b[row + x] * scale[x];
+            }
+            if (splatWeight > 0) {
+                float splatScale = settings.exposure / splatWeight;
+                for (int x = 0; x < width; ++x) {
+                    cr[x] += splatR[row + x] * splatScale;
+                    cg[x] += splatG[row + x] * splatScale;
+                    cb[x] += splatB[row + x] * splatScale;
+                }
+            }
+        }
+
+        ApplyToneMap(settings.toneMap, cr.data(), width);
+        ApplyToneMap(settings.toneMap, cg.data(), width);
+        ApplyToneMap(settings.toneMap, cb.data(), width);
+
+        Quantize(settings.srgb, cr.data(), qr.data(), width);
+        Quantize(settings.srgb, cg.data(), qg.data(), width);
+        Quantize(settings.srgb, cb.data(), qb.data(), width);
+
+        for (int x = 0; x < width; ++x)
+            image.set_pixel(x, y, qr[x], qg[x], qb[x]);
+    }
+}
+
+void Film::ResolveSampleCount(bitmap_image& image) const {
+    float maxCount = *std::max_element(count.begin(), count.end());
+    float scale = maxCount > 0 ? 255 / maxCount : 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned char c = (unsigned char)(count[size_t(y) * width + x] * scale + 0.5f);
+            image.set_pixel(x, y, c, c, c);
+        }
+    }
+}
+
+std::vector<float> Film::Snapshot() const {
+    size_t channels = Channels();
+    int storedBuckets = buckets > 1 ? buckets : 0;
+    std::vector<float> pixels(w.size() * channels);
+    for (size_t i = 0; i < w.size(); ++i) {
+        float* p = &pixels[channels * i];
+        p[0] = r[i];
+        p[1] = g[i];
+        p[2] = b[i];
+        p[3] = w[i];
+        p[4] = count[i];
+        p[5] = lumMean[i];
+        p[6] = lumM2[i];
+        p[7] = splatR[i];
+        p[8] = splatG[i];
+        p[9] = splatB[i];
+        p[10] = splatWeight;
+        for (int k = 0; k < storedBuckets; ++k) {
+            size_t j = k * r.size() + i;
+            float* q = p + CHANNELS + BUCKET_CHANNELS * k;
+            q[0] = bucketR[j];
+            q[1] = bucketG[j];
+            q[2] = bucketB[j];
+            q[3] = bucketW[j];
+        }
+    }
+    return pixels;
+}
+
+bool Film::Restore(const CheckpointData& data) {
+    size_t channels = Channels();
+    if (data.width != width || data.height != height || size_t(data.channels) != channels) {
+        std::cerr << "checkpoint does not match the resolution or layout of the film" << std::endl;
+        return false;
+    }
+
+    int storedBuckets = buckets > 1 ? buckets : 0;
+    for (size_t i = 0; i < w.size(); ++i) {
+        const float* p = &data.pixels[channels * i];
+        r[i] = p[0];
+        g[i] = p[1];
+        b[i] = p[2];
+        w[i] = p[3];
+        count[i] = p[4];
+        lumMean[i] = p[5];
+        lumM2[i] = p[6];
+        splatR[i] = p[7];
+        splatG[i] = p[8];
+        splatB[i] = p[9];
+        splatWeight = p[10];
+        for (int k = 0; k < storedBuckets; ++k) {
+            size_t j = k * r.size() + i;
+            const float* q = p + CHANNELS + BUCKET_CHANNELS * k;
+            bucketR[j] = q[0];
+            bucketG[j] = q[1];
+            bucketB[j] = q[2];
+            bucketW[j] = q[3];
+        }
+    }
+    return true;
+}
+
+FilmTile::FilmTile(Film& film, int x0, int y0, int x1, int y1) : film(film) {
+    // a sample in pixel x reaches the centres of pixels x +- k for k < radius + 1/2
+    int border = int(std::ceil(film.GetFilter().Radius() + 0.5f)) - 1;
+    this->x0 = std::max(x0 - border, 0);
+    this->y0 = std::max(y0 - border, 0);
+    this->x1 = std::min(x1 + border, film.Width());
+    this->y1 = std::min(y1 + border, film.Height());
+
+    size_t n = size_t(this->x1 - this->x0) * (this->y1 - this->y0);
+    r.resize(n);
+    g.resize(n);
+    b.resize(n);
+    w.resize(n);
+    if (film.Buckets() > 1) {
+        bucketR.resize(n * film.Buckets());
+        bucketG.resize(n * film.Buckets());
+        bucketB.resize(n * film.Buckets());
+        bucketW.resize(n * film.Buckets());
+    }
+}
+
+void FilmTile::AddSample(int x, int y, const glm::vec2& pFilm, const glm::vec3& L) {
+    const Filter& filter = film.GetFilter();
+    float radius = filter.Radius();
+    int bucket = film.Buckets() > 1 ? film.SampleCount(x, y) % film.Buckets() : 0;
+    film.AddStatistics(x, y, L);
+
+    // pixel centres in (p - radius, p + radius], with pixel centres at integers
+    glm::vec2 p = pFilm - glm::vec2(0.5f, 0.5f);
+    int px0 = std::max(int(std::floor(p.x - radius)) + 1, x0);
+    int px1 = std::min(int(std::floor(p.x + radius)), x1 - 1);
+    int py0 = std::max(int(std::floor(p.y - radius)) + 1, y0);
+    int py1 = std::min(int(std::floor(p.y + radius)), y1 - 1);
+
+    int tileWidth = x1 - x0;
+    for (int py = py0; py <= py1; ++py) {
+        float wy = filter.Evaluate1D(py - p.y);
+        if (wy == 0)
+            continue;
+        for (int px = px0; px <= px1; ++px) {
+            float weight = wy * filter.Evaluate1D(px - p.x);
+            size_t i = size_t(py - y0) * tileWidth + (px - x0);
+            r[i] += weight * L.r;
+            g[i] += weight * L.g;
+            b[i] += weight * L.b;
+            w[i] += weight;
+
+            if (!bucketW.empty()) {
+                size_t k = bucket * w.size() + i;
+                bucketR[k] += weight * L.r;
+                bucketG[k] += weight * L.g;
+                bucketB[k] += weight * L.b;
+                bucketW[k] += weight;
+            }
+        }
+    }
+}
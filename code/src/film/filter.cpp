@@ -0,0 +1,80 @@
+#include <thinlens/film/filter.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // standard deviation of the Gaussian, in pixels
+    const float GAUSSIAN_SIGMA = 0.5f;
+    // the B and C Mitchell and Netravali recommend
+    const float MITCHELL_B = 1.f / 3;
+    const float MITCHELL_C = 1.f / 3;
+
+    float Gaussian(float d) {
+        return std::exp(-d * d / (2 * GAUSSIAN_SIGMA * GAUSSIAN_SIGMA));
+    }
+
+    // x is the distance relative to the radius, scaled to [0, 2]
+    float Mitchell(float x) {
+        const float B = MITCHELL_B;
+        const float C = MITCHELL_C;
+        if (x < 1)
+            return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6;
+        if (x < 2)
+            return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+        return 0;
+    }
+};
+
+bool ParseFilter(const std::string& name, FilterType& type) {
+    if (name == "box") {
+        type = FilterType::Box;
+    } else if (name == "tent") {
+        type = FilterType::Tent;
+    } else if (name == "gaussian") {
+        type = FilterType::Gaussian;
+    } else if (name == "mitchell") {
+        type = FilterType::Mitchell;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+float DefaultFilterRadius(FilterType type) {
+    switch (type) {
+    case FilterType::Box:
+        return 0.5f;
+    case FilterType::Tent:
+        return 1.f;
+    case FilterType::Gaussian:
+        return 1.5f;
+    case FilterType::Mitchell:
+        return 2.f;
+    }
+    return 0.5f;
+}
+
+Filter::Filter(FilterType type, float radius) : type(type), radius(radius), scale(TABLE_SIZE / radius) {
+    // the Gaussian is shifted down to reach zero at the radius
+    float gaussianEdge = Gaussian(radius);
+
+    for (int i = 0; i < TABLE_SIZE; ++i) {
+        // at the middle of the interval the entry stands for
+        float d = (i + 0.5f) / scale;
+        switch (type) {
+        case FilterType::Box:
+            table[i] = 1;
+            break;
+        case FilterType::Tent:
+            table[i] = 1 - d / radius;
+            break;
+        case FilterType::Gaussian:
+            table[i] = std::max(0.f, Gaussian(d) - gaussianEdge);
+            break;
+        case FilterType::Mitchell:
+            table[i] = Mitchell(2 * d / radius);
+            break;
+        }
+    }
+}
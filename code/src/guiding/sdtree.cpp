@@ -0,0 +1,273 @@
+#include <thinlens/guiding/sdtree.h>
+
+#include <algorithm>
+#include <cmath>
+
+#define PI 3.141592653589793238462643383279502884
+
+namespace {
+    // samples per leaf (in the first iteration) above which a region is split
+    const float SPATIAL_THRESHOLD = 12000;
+    // fraction of the energy above which a quadrant is split
+    const float DIRECTIONAL_THRESHOLD = 0.01f;
+    const int MAX_DIRECTIONAL_DEPTH = 20;
+
+    void AtomicAdd(std::atomic<float>& a, float v) {
+        float old = a.load(std::memory_order_relaxed);
+        while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed))
+            ;
+    }
+
+    // equal area mapping between the sphere and the unit square
+    glm::vec2 DirectionToSquare(const glm::vec3& w) {
+        float cosTheta = std::min(1.f, std::max(-1.f, w.z));
+        float phi = std::atan2(w.y, w.x);
+        if (phi < 0)
+            phi += 2 * float(PI);
+        return glm::vec2(std::min(0.5f * (cosTheta + 1), 1 - 1e-7f),
+                         std::min(phi / (2 * float(PI)), 1 - 1e-7f));
+    }
+
+    glm::vec3 SquareToDirection(const glm::vec2& p) {
+        float cosTheta = 2 * p.x - 1;
+        float sinTheta = std::sqrt(std::max(0.f, 1 - cosTheta * cosTheta));
+        float phi = 2 * float(PI) * p.y;
+        return glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+    // picks the lower half with probability p and rescales u to [0, 1)
+    int Choose(float& u, float p) {
+        if (u < p) {
+            u = std::min(u / p, 1 - 1e-7f);
+            return 0;
+        }
+        u = std::min((u - p) / (1 - p), 1 - 1e-7f);
+        return 1;
+    }
+};
+
+DTree::Node::Node() {
+    for (int q = 0; q < 4; ++q) {
+        sum[q].store(0, std::memory_order_relaxed);
+        child[q] = 0;
+    }
+}
+
+DTree::Node::Node(const Node& other) {
+    *this = other;
+}
+
+DTree::Node& DTree::Node::operator=(const Node& other) {
+    for (int q = 0; q < 4; ++q) {
+        sum[q].store(other.sum[q].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        child[q] = other.child[q];
+    }
+    return *this;
+}
+
+DTree::DTree() : nodes(1), samples(0) {}
+
+DTree::DTree(const DTree& other) : nodes(other.nodes), samples(other.SampleCount()) {}
+
+DTree& DTree::operator=(const DTree& other) {
+    nodes = other.nodes;
+    samples.store(other.SampleCount(), std::memory_order_relaxed);
+    return *this;
+}
+
+void DTree::Record(const glm::vec3& w, float radiance) {
+    samples.fetch_add(1, std::memory_order_relaxed);
+    if (!(radiance > 0) || std::isinf(radiance))
+        return;
+
+    glm::vec2 p = DirectionToSquare(w);
+    int index = 0;
+    for (;;) {
+        int x = p.x >= 0.5f;
+        int y = p.y >= 0.5f;
+        int q = x + 2 * y;
+        AtomicAdd(nodes[index].sum[q], radiance);
+        if (nodes[index].child[q] == 0)
+            return;
+        index = nodes[index].child[q];
+        p = 2.f * p - glm::vec2(x, y);
+    }
+}
+
+bool DTree::Empty() const {
+    const Node& root = nodes[0];
+    float total = 0;
+    for (int q = 0; q < 4; ++q)
+        total += root.sum[q].load(std::memory_order_relaxed);
+    return total <= 0;
+}
+
+glm::vec3 DTree::Sample(glm::vec2 u, float& pdf) const {
+    glm::vec2 p(0, 0);
+    float size = 1;
+    float density = 1; // with respect to area on the unit square
+    int index = 0;
+
+    for (;;) {
+        const Node& node = nodes[index];
+        float s[4];
+        for (int q = 0; q < 4; ++q)
+            s[q] = node.sum[q].load(std::memory_order_relaxed);
+        float total = s[0] + s[1] + s[2] + s[3];
+        if (total <= 0) {
+            p += size * u;
+            break;
+        }
+
+        int x = Choose(u.x, (s[0] + s[2]) / total);
+        int y = Choose(u.y, s[x] / (s[x] + s[x + 2]));
+        int q = x + 2 * y;
+        density *= 4 * s[q] / total;
+        size *= 0.5f;
+        p += size * glm::vec2(x, y);
+
+        if (node.child[q] == 0) {
+            p += size * u;
+            break;
+        }
+        index = node.child[q];
+    }
+
+    pdf = density / (4 * float(PI));
+    return SquareToDirection(p);
+}
+
+float DTree::Pdf(const glm::vec3& w) const {
+    glm::vec2 p = DirectionToSquare(w);
+    float density = 1;
+    int index = 0;
+
+    for (;;) {
+        const Node& node = nodes[index];
+        float s[4];
+        for (int q = 0; q < 4; ++q)
+            s[q] = node.sum[q].load(std::memory_order_relaxed);
+        float total = s[0] + s[1] + s[2] + s[3];
+        if (total <= 0)
+            break;
+
+        int x = p.x >= 0.5f;
+        int y = p.y >= 0.5f;
+        int q = x + 2 * y;
+        density *= 4 * s[q] / total;
+        if (node.child[q] == 0)
+            break;
+        index = node.child[q];
+        p = 2.f * p - glm::vec2(x, y);
+    }
+
+    return density / (4 * float(PI));
+}
+
+void DTree::Refine(float threshold, int maxDepth) {
+    std::vector<Node> old;
+    old.swap(nodes);
+
+    float sums[4];
+    float total = 0;
+    for (int q = 0; q < 4; ++q) {
+        sums[q] = old[0].sum[q].load(std::memory_order_relaxed);
+        total += sums[q];
+    }
+    Subdivide(old, 0, sums, total, threshold, 1, maxDepth);
+    samples.store(0, std::memory_order_relaxed);
+}
+
+/*
+    Appends a node for a quadrant that held sums in the old
+    tree, and the nodes below it. Quadrants that were not
+    split in the old tree are assumed to be uniform inside.
+*/
+int DTree::Subdivide(const std::vector<Node>& old, int oldIndex, const float sums[4],
+                     float total, float threshold, int depth, int maxDepth) {
+    int index = nodes.size();
+    nodes.push_back(Node());
+
+    for (int q = 0; q < 4; ++q) {
+        if (total <= 0 || depth >= maxDepth || sums[q] <= threshold * total)
+            continue;
+
+        int oldChild = oldIndex >= 0 ? old[oldIndex].child[q] : 0;
+        float childSums[4];
+        for (int c = 0; c < 4; ++c)
+            childSums[c] = oldChild != 0 ? old[oldChild].sum[c].load(std::memory_order_relaxed) : sums[q] / 4;
+
+        int child = Subdivide(old, oldChild != 0 ? oldChild : -1, childSums, total, threshold, depth + 1, maxDepth);
+        nodes[index].child[q] = child;
+    }
+
+    return index;
+}
+
+void DTree::HalveSampleCount() {
+    samples.store(SampleCount() / 2, std::memory_order_relaxed);
+}
+
+SDTree::SDTree(const glm::vec3& pMin, const glm::vec3& pMax)
+    : pMin(pMin), pMax(pMax), leaves(1)
+{
+    nodes.push_back({0, 0, 0});
+}
+
+int SDTree::Leaf(const glm::vec3& p) const {
+    glm::vec3 lo = pMin;
+    glm::vec3 hi = pMax;
+    int index = 0;
+    while (nodes[index].child != 0) {
+        int axis = nodes[index].axis;
+        float mid = 0.5f * (lo[axis] + hi[axis]);
+        if (p[axis] < mid) {
+            hi[axis] = mid;
+            index = nodes[index].child;
+        } else {
+            lo[axis] = mid;
+            index = nodes[index].child + 1;
+        }
+    }
+    return nodes[index].leaf;
+}
+
+void SDTree::Refine(int iteration) {
+    float threshold = SPATIAL_THRESHOLD * std::sqrt(std::pow(2.f, float(iteration)));
+
+    // leaves that are split are handled recursively
+    int n = nodes.size();
+    for (int i = 0; i < n; ++i) {
+        if (nodes[i].child == 0)
+            Split(i, threshold);
+    }
+
+    for (Region& region : leaves) {
+        region.sampling = region.building;
+        region.building.Refine(DIRECTIONAL_THRESHOLD, MAX_DIRECTIONAL_DEPTH);
+    }
+}
+
+/*
+    Splits the leaf node in two while it has more samples
+    than threshold. Both halves start from a copy of its
+    trees, with half of its samples each.
+*/
+void SDTree::Split(int node, float threshold) {
+    int leaf = nodes[node].leaf;
+    if (leaves[leaf].building.SampleCount() <= threshold)
+        return;
+
+    leaves[leaf].building.HalveSampleCount();
+    leaves.push_back(leaves[leaf]);
+
+    int axis = (nodes[node].axis + 1) % 3;
+    int first = nodes.size();
+    nodes[node].child = first;
+    nodes[node].leaf = -1;
+    nodes.push_back({axis, 0, leaf});
+    nodes.push_back({axis, 0, int(leaves.size()) - 1});
+
+    Split(first, threshold);
+    Split(first + 1, threshold);
+}
@@ -0,0 +1,47 @@
+#include <thinlens/light/aliastable.h>
+
+#include <algorithm>
+
+AliasTable::AliasTable(const std::vector<float>& weights) : bins(weights.size()) {
+    double sum = 0;
+    for (float w : weights)
+        sum += w;
+
+    size_t n = weights.size();
+    std::vector<int> under, over;
+    std::vector<double> q(n);
+    for (size_t i = 0; i < n; ++i) {
+        bins[i].p = sum > 0 ? float(weights[i] / sum) : 1.f / n;
+        q[i] = sum > 0 ? weights[i] * n / sum : 1;
+        bins[i].alias = int(i);
+        (q[i] < 1 ? under : over).push_back(int(i));
+    }
+
+    // pair every underfull bin with an overfull one that tops it up
+    while (!under.empty() && !over.empty()) {
+        int u = under.back(); under.pop_back();
+        int o = over.back(); over.pop_back();
+
+        bins[u].q = float(q[u]);
+        bins[u].alias = o;
+
+        q[o] -= 1 - q[u];
+        (q[o] < 1 ? under : over).push_back(o);
+    }
+
+    // whatever is left is full up to rounding errors
+    for (int i : under)
+        bins[i].q = 1;
+    for (int i : over)
+        bins[i].q = 1;
+}
+
+int AliasTable::Sample(float u, float& pmf) const {
+    float scaled = u * bins.size();
+    int i = std::min(int(scaled), int(bins.size()) - 1);
+    float up = scaled - i;
+
+    int chosen = up < bins[i].q ? i : bins[i].alias;
+    pmf = bins[chosen].p;
+    return chosen;
+}
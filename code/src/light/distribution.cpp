@@ -0,0 +1,64 @@
+#include <thinlens/light/distribution.h>
+
+#include <algorithm>
+#include <cmath>
+
+Distribution1D::Distribution1D(const float* f, int n)
+    : func(f, f + n), cdf(n + 1)
+{
+    cdf[0] = 0;
+    for (int i = 0; i < n; ++i)
+        cdf[i + 1] = cdf[i] + std::abs(func[i]) / n;
+    integral = cdf[n];
+
+    // a density that is zero everywhere becomes uniform
+    for (int i = 1; i <= n; ++i)
+        cdf[i] = integral > 0 ? cdf[i] / integral : float(i) / n;
+}
+
+float Distribution1D::Sample(float u, float& pdf, int& offset) const {
+    // last entry of the cdf that is <= u
+    offset = int(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) - 1;
+    offset = std::max(0, std::min(offset, Count() - 1));
+
+    float du = u - cdf[offset];
+    float width = cdf[offset + 1] - cdf[offset];
+    if (width > 0)
+        du /= width;
+
+    pdf = Pdf(offset);
+    return std::min((offset + du) / Count(), 0.99999994f);
+}
+
+float Distribution1D::Pdf(int offset) const {
+    if (integral == 0)
+        return 1;
+    return std::abs(func[offset]) / integral;
+}
+
+Distribution2D::Distribution2D(const float* f, int nu, int nv) {
+    conditional.reserve(nv);
+    std::vector<float> rows(nv);
+    for (int v = 0; v < nv; ++v) {
+        conditional.push_back(Distribution1D(f + v * nu, nu));
+        rows[v] = conditional.back().Integral();
+    }
+    marginal = Distribution1D(rows.data(), nv);
+}
+
+glm::vec2 Distribution2D::Sample(const glm::vec2& u, float& pdf) const {
+    float pdfV, pdfU;
+    int v, offsetU;
+    float d1 = marginal.Sample(u.y, pdfV, v);
+    float d0 = conditional[v].Sample(u.x, pdfU, offsetU);
+    pdf = pdfV * pdfU;
+    return glm::vec2(d0, d1);
+}
+
+float Distribution2D::Pdf(const glm::vec2& p) const {
+    int nu = conditional[0].Count();
+    int nv = marginal.Count();
+    int iu = std::max(0, std::min(int(p.x * nu), nu - 1));
+    int iv = std::max(0, std::min(int(p.y * nv), nv - 1));
+    return marginal.Pdf(iv) * conditional[iv].Pdf(iu);
+}
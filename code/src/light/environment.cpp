@@ -0,0 +1,219 @@
+#include <thinlens/light/environment.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#define PI 3.141592653589793238462643383279502884
+
+namespace {
+    float Luminance(const glm::vec3& c) {
+        return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+    }
+
+    // (u, v) of the latitude-longitude map for direction w
+    glm::vec2 DirectionToUV(const glm::vec3& w) {
+        float theta = std::acos(std::max(-1.f, std::min(1.f, -w.y)));
+        float phi = std::atan2(w.z, w.x);
+        if (phi < 0)
+            phi += 2 * float(PI);
+        return glm::vec2(phi / (2 * float(PI)), theta / float(PI));
+    }
+
+    glm::vec3 UVToDirection(const glm::vec2& uv, float& sinTheta) {
+        float theta = uv.y * float(PI);
+        float phi = uv.x * 2 * float(PI);
+        sinTheta = std::sin(theta);
+        return glm::vec3(sinTheta * std::cos(phi), -std::cos(theta), sinTheta * std::sin(phi));
+    }
+
+    glm::vec3 FromRGBE(const unsigned char rgbe[4]) {
+        if (rgbe[3] == 0)
+            return glm::vec3(0, 0, 0);
+        float f = std::ldexp(1.f, int(rgbe[3]) - (128 + 8));
+        return glm::vec3(rgbe[0] * f, rgbe[1] * f, rgbe[2] * f);
+    }
+
+    // one scanline of width pixels, as four bytes each
+    bool ReadScanline(FILE* file, int width, std::vector<unsigned char>& line) {
+        unsigned char start[4];
+        if (fread(start, 1, 4, file) != 4)
+            return false;
+
+        // run-length encoded scanlines store each component separately
+        if (width >= 8 && width < 32768 && start[0] == 2 && start[1] == 2 && !(start[2] & 0x80)) {
+            if ((start[2] << 8 | start[3]) != width)
+                return false;
+
+            for (int c = 0; c < 4; ++c) {
+                int x = 0;
+                while (x < width) {
+                    int count = fgetc(file);
+                    if (count == EOF)
+                        return false;
+                    if (count > 128) {
+                        // a run of one value
+                        count -= 128;
+                        int value = fgetc(file);
+                        if (value == EOF || x + count > width)
+                            return false;
+                        for (int i = 0; i < count; ++i)
+                            line[4 * (x++) + c] = value;
+                    } else {
+                        if (count == 0 || x + count > width)
+                            return false;
+                        for (int i = 0; i < count; ++i) {
+                            int value = fgetc(file);
+                            if (value == EOF)
+                                return false;
+                            line[4 * (x++) + c] = value;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+
+        // flat pixels, possibly with the runs of the old format: a
+        // pixel of (1, 1, 1, n) repeats the one before it
+        memcpy(&line[0], start, 4);
+        int x = 1;
+        int shift = 0;
+        while (x < width) {
+            unsigned char* pixel = &line[4 * x];
+            if (fread(pixel, 1, 4, file) != 4)
+                return false;
+            if (pixel[0] == 1 && pixel[1] == 1 && pixel[2] == 1) {
+                int count = pixel[3] << shift;
+                if (x + count > width)
+                    return false;
+                for (int i = 0; i < count; ++i, ++x)
+                    memcpy(&line[4 * x], &line[4 * (x - 1)], 4);
+                shift += 8;
+            } else {
+                ++x;
+                shift = 0;
+            }
+        }
+        return true;
+    }
+};
+
+glm::vec3 ConstantEnvironment::Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const {
+    float z = 1 - 2 * u.x;
+    float r = std::sqrt(std::max(0.f, 1 - z * z));
+    float phi = 2 * float(PI) * u.y;
+    w = glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+    pdf = 1 / (4 * float(PI));
+    return radiance;
+}
+
+float ConstantEnvironment::Pdf(const glm::vec3& /* w */) const {
+    return 1 / (4 * float(PI));
+}
+
+float ConstantEnvironment::MeanLuminance() const {
+    return Luminance(radiance);
+}
+
+ImageEnvironment::ImageEnvironment(const std::vector<glm::vec3>& image, int width, int height, float scale)
+    : pixels(image), width(width), height(height), meanLuminance(0)
+{
+    // luminance times the solid angle of the pixels, which
+    // shrinks towards the poles
+    std::vector<float> weights(width * height);
+    double sum = 0;
+    for (int y = 0; y < height; ++y) {
+        float sinTheta = std::sin((y + 0.5f) / height * float(PI));
+        for (int x = 0; x < width; ++x) {
+            glm::vec3& L = pixels[y * width + x];
+            L *= scale;
+            weights[y * width + x] = Luminance(L) * sinTheta;
+            sum += weights[y * width + x];
+        }
+    }
+
+    // mean over the sphere: the sum of weights times the area of a
+    // pixel in (theta, phi), over 4 pi
+    meanLuminance = float(sum * (2 * PI * PI / (width * height)) / (4 * PI));
+    distribution = Distribution2D(weights.data(), width, height);
+}
+
+glm::vec3 ImageEnvironment::Lookup(const glm::vec2& uv) const {
+    int x = std::max(0, std::min(int(uv.x * width), width - 1));
+    int y = std::max(0, std::min(int(uv.y * height), height - 1));
+    return pixels[y * width + x];
+}
+
+glm::vec3 ImageEnvironment::Le(const glm::vec3& w) const {
+    return Lookup(DirectionToUV(w));
+}
+
+glm::vec3 ImageEnvironment::Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const {
+    float pdfUV;
+    glm::vec2 uv = distribution.Sample(u, pdfUV);
+    float sinTheta;
+    w = UVToDirection(uv, sinTheta);
+
+    // (u, v) covers 2 pi x pi of (phi, theta), and d omega = sin theta d theta d phi
+    pdf = sinTheta > 0 ? pdfUV / (2 * float(PI) * float(PI) * sinTheta) : 0;
+    if (pdf == 0)
+        return glm::vec3(0, 0, 0);
+    return Lookup(uv);
+}
+
+float ImageEnvironment::Pdf(const glm::vec3& w) const {
+    glm::vec2 uv = DirectionToUV(w);
+    float sinTheta = std::sin(uv.y * float(PI));
+    if (sinTheta <= 0)
+        return 0;
+    return distribution.Pdf(uv) / (2 * float(PI) * float(PI) * sinTheta);
+}
+
+bool LoadRGBE(const std::string& path, std::vector<glm::vec3>& pixels, int& width, int& height) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "could not open environment map " << path << std::endl;
+        return false;
+    }
+
+    // header lines up to an empty one, then the resolution
+    char line[512];
+    bool radiance = fgets(line, sizeof(line), file) && strncmp(line, "#?", 2) == 0;
+    bool rgbe = true;
+    while (radiance && fgets(line, sizeof(line), file) && line[0] != '\n') {
+        if (strncmp(line, "FORMAT=", 7) == 0)
+            rgbe = strncmp(line + 7, "32-bit_rle_rgbe", 15) == 0;
+    }
+    if (!radiance || !rgbe || !fgets(line, sizeof(line), file)
+        || sscanf(line, "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+        std::cerr << path << " is not a Radiance RGBE image with -Y +X scanlines" << std::endl;
+        fclose(file);
+        return false;
+    }
+
+    pixels.resize(size_t(width) * height);
+    std::vector<unsigned char> scanline(4 * width);
+    for (int y = 0; y < height; ++y) {
+        if (!ReadScanline(file, width, scanline)) {
+            std::cerr << "environment map " << path << " is truncated or corrupt" << std::endl;
+            fclose(file);
+            return false;
+        }
+        for (int x = 0; x < width; ++x)
+            pixels[y * width + x] = FromRGBE(&scanline[4 * x]);
+    }
+
+    fclose(file);
+    return true;
+}
+
+Environment* LoadEnvironment(const std::string& path, float scale) {
+    std::vector<glm::vec3> pixels;
+    int width, height;
+    if (!LoadRGBE(path, pixels, width, height))
+        return nullptr;
+    return new ImageEnvironment(pixels, width, height, scale);
+}
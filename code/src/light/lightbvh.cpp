@@ -0,0 +1,326 @@
+#include <thinlens/light/lightbvh.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#define PI 3.141592653589793238462643383279502884
+
+namespace {
+    float SafeSqrt(float x) {
+        return std::sqrt(std::max(0.f, x));
+    }
+
+    float SafeAcos(float x) {
+        return std::acos(std::min(1.f, std::max(-1.f, x)));
+    }
+
+    // cos(max(0, a - b)) and sin(max(0, a - b)) from sines and cosines
+    float CosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        if (cosA > cosB)
+            return 1;
+        return cosA * cosB + sinA * sinB;
+    }
+
+    float SinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+        if (cosA > cosB)
+            return 0;
+        return sinA * cosB - cosA * sinB;
+    }
+
+    // rotates v by angle theta around the unit axis k (Rodrigues' formula)
+    glm::vec3 Rotate(const glm::vec3& v, const glm::vec3& k, float theta) {
+        float c = std::cos(theta);
+        float s = std::sin(theta);
+        return v * c + glm::cross(k, v) * s + k * glm::dot(k, v) * (1 - c);
+    }
+
+    /*
+        Cosine of the half angle of the cone of directions 
+        from p that hit the bounding sphere of the box.
+    */
+    float BoundSubtendedCos(const glm::vec3& pMin, const glm::vec3& pMax, const glm::vec3& p) {
+        if (p.x >= pMin.x && p.y >= pMin.y && p.z >= pMin.z && p.x <= pMax.x && p.y <= pMax.y && p.z <= pMax.z)
+            return -1;
+
+        glm::vec3 c = 0.5f * (pMin + pMax);
+        float r2 = glm::dot(pMax - c, pMax - c);
+        float d2 = glm::dot(p - c, p - c);
+        if (d2 < r2)
+            return -1;
+        return SafeSqrt(1 - r2 / d2);
+    }
+
+    /*
+        Cost of a set of lights for the surface area orientation
+        heuristic: power times the measure of the directions 
+        they emit into times the surface area of their bounds,
+        penalizing boxes that are thin along the split axis.
+    */
+    float Cost(const LightBounds& b, int axis) {
+        float theta_o = SafeAcos(b.cosTheta_o);
+        float theta_e = SafeAcos(b.cosTheta_e);
+        float theta_w = std::min(theta_o + theta_e, float(PI));
+        float sinTheta_o = SafeSqrt(1 - b.cosTheta_o * b.cosTheta_o);
+        float M_omega = 2 * PI * (1 - b.cosTheta_o) +
+            PI / 2 * (2 * theta_w * sinTheta_o - std::cos(theta_o - 2 * theta_w) -
+                      2 * theta_o * sinTheta_o + b.cosTheta_o);
+
+        glm::vec3 d = b.pMax - b.pMin;
+        float area = 2 * (d.x * d.y + d.x * d.z + d.y * d.z);
+        float maxExtent = std::max(d.x, std::max(d.y, d.z));
+        float Kr = d[axis] > 0 ? maxExtent / d[axis] : 1;
+        return b.phi * M_omega * Kr * area;
+    }
+
+    const int BINS = 12;
+    // bits of a trail, so interior nodes may not be this deep
+    const int MAX_DEPTH = 64;
+
+    // levels a tree over n lights needs when split by count
+    int CountDepth(int n) {
+        int levels = 0;
+        while ((int64_t(1) << levels) < n)
+            ++levels;
+        return levels;
+    }
+};
+
+LightBounds::LightBounds()
+    : pMin(std::numeric_limits<float>::max()), pMax(-std::numeric_limits<float>::max()),
+      w(0, 0, 1), cosTheta_o(1), cosTheta_e(1), phi(0) {}
+
+LightBounds::LightBounds(const Triangle& triangle)
+    : pMin(glm::min(triangle.v0, glm::min(triangle.v1, triangle.v2))),
+      pMax(glm::max(triangle.v0, glm::max(triangle.v1, triangle.v2))),
+      w(triangle.normal), cosTheta_o(1), cosTheta_e(0), phi(LightPower(triangle)) {}
+
+float LightBounds::Importance(const glm::vec3& p, const glm::vec3& n) const {
+    glm::vec3 pc = Centroid();
+    float d2 = glm::dot(p - pc, p - pc);
+    // do not let the importance blow up for points inside or near the box
+    d2 = std::max(d2, 0.5f * glm::length(pMax - pMin));
+
+    glm::vec3 wi = d2 > 0 ? glm::normalize(p - pc) : glm::vec3(0, 0, 1);
+    float cosTheta_w = glm::dot(w, wi);
+    float sinTheta_w = SafeSqrt(1 - cosTheta_w * cosTheta_w);
+
+    float cosTheta_b = BoundSubtendedCos(pMin, pMax, p);
+    float sinTheta_b = SafeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    // smallest angle between p and the emission directions of the bounds
+    float sinTheta_o = SafeSqrt(1 - cosTheta_o * cosTheta_o);
+    float cosTheta_x = CosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float sinTheta_x = SinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float cosThetap = CosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= cosTheta_e)
+        return 0;
+
+    float importance = phi * cosThetap / d2;
+
+    // smallest angle between the surface normal and the bounds
+    float cosTheta_i = std::abs(glm::dot(wi, n));
+    float sinTheta_i = SafeSqrt(1 - cosTheta_i * cosTheta_i);
+    importance *= CosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+
+    return std::max(importance, 0.f);
+}
+
+LightBounds Union(const LightBounds& a, const LightBounds& b) {
+    if (a.phi == 0)
+        return b;
+    if (b.phi == 0)
+        return a;
+
+    LightBounds u;
+    u.pMin = glm::min(a.pMin, b.pMin);
+    u.pMax = glm::max(a.pMax, b.pMax);
+    u.phi = a.phi + b.phi;
+    u.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+
+    // smallest cone around both normal cones
+    float theta_a = SafeAcos(a.cosTheta_o);
+    float theta_b = SafeAcos(b.cosTheta_o);
+    float theta_d = SafeAcos(glm::dot(a.w, b.w));
+    if (std::min(theta_d + theta_b, float(PI)) <= theta_a) {
+        u.w = a.w;
+        u.cosTheta_o = a.cosTheta_o;
+    } else if (std::min(theta_d + theta_a, float(PI)) <= theta_b) {
+        u.w = b.w;
+        u.cosTheta_o = b.cosTheta_o;
+    } else {
+        float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+        glm::vec3 axis = glm::cross(a.w, b.w);
+        if (theta_o >= PI || glm::dot(axis, axis) == 0) {
+            u.w = a.w;
+            u.cosTheta_o = -1;
+        } else {
+            u.w = Rotate(a.w, glm::normalize(axis), theta_o - theta_a);
+            u.cosTheta_o = std::cos(theta_o);
+        }
+    }
+    return u;
+}
+
+BVHLightSampler::BVHLightSampler(const std::vector<Triangle>& triangles)
+    : LightSampler(triangles), bitTrails(lights.size(), 0)
+{
+    std::vector<std::pair<int, LightBounds>> items;
+    for (size_t i = 0; i < lights.size(); ++i) {
+        LightBounds b(triangles[lights[i]]);
+        if (b.phi > 0)
+            items.push_back(std::make_pair(int(i), b));
+    }
+
+    if (!items.empty())
+        Build(items, 0, int(items.size()), 0, 0);
+}
+
+int BVHLightSampler::Build(std::vector<std::pair<int, LightBounds>>& items, int begin, int end, uint64_t bitTrail, int depth) {
+    if (end - begin == 1) {
+        Node leaf;
+        leaf.bounds = items[begin].second;
+        leaf.child1 = -1;
+        leaf.light = items[begin].first;
+        nodes.push_back(leaf);
+        bitTrails[leaf.light] = bitTrail;
+        return int(nodes.size()) - 1;
+    }
+
+    LightBounds bounds, centroids;
+    for (int i = begin; i < end; ++i) {
+        bounds = Union(bounds, items[i].second);
+        glm::vec3 c = items[i].second.Centroid();
+        centroids.pMin = glm::min(centroids.pMin, c);
+        centroids.pMax = glm::max(centroids.pMax, c);
+    }
+
+    // find the cheapest split into bins along any axis
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1, bestBin = -1;
+    for (int axis = 0; axis < 3; ++axis) {
+        float lo = centroids.pMin[axis];
+        float extent = centroids.pMax[axis] - lo;
+        if (extent <= 0)
+            continue;
+
+        LightBounds bins[BINS];
+        for (int i = begin; i < end; ++i) {
+            int b = std::min(BINS - 1, int(BINS * (items[i].second.Centroid()[axis] - lo) / extent));
+            bins[b] = Union(bins[b], items[i].second);
+        }
+
+        for (int split = 0; split < BINS - 1; ++split) {
+            LightBounds left, right;
+            for (int b = 0; b <= split; ++b)
+                left = Union(left, bins[b]);
+            for (int b = split + 1; b < BINS; ++b)
+                right = Union(right, bins[b]);
+            if (left.phi == 0 || right.phi == 0)
+                continue;
+
+            float cost = Cost(left, axis) + Cost(right, axis);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = split;
+            }
+        }
+    }
+
+    /*
+        Lopsided splits can make deep chains of clustered lights.
+        Once only the levels a split by count needs are left,
+        the rest of the subtree is split by count, which keeps
+        every trail within its 64 bits.
+    */
+    assert(depth + CountDepth(end - begin) <= MAX_DEPTH);
+    int mid;
+    if (bestAxis < 0 || depth + CountDepth(end - begin) >= MAX_DEPTH) {
+        // all centroids coincide, or no levels to spare: split by count
+        mid = (begin + end) / 2;
+    } else {
+        float lo = centroids.pMin[bestAxis];
+        float extent = centroids.pMax[bestAxis] - lo;
+        mid = int(std::partition(items.begin() + begin, items.begin() + end,
+            [&](const std::pair<int, LightBounds>& item) {
+                int b = std::min(BINS - 1, int(BINS * (item.second.Centroid()[bestAxis] - lo) / extent));
+                return b <= bestBin;
+            }) - items.begin());
+        if (mid == begin || mid == end)
+            mid = (begin + end) / 2;
+    }
+
+    int index = int(nodes.size());
+    Node node;
+    node.bounds = bounds;
+    node.light = -1;
+    nodes.push_back(node);
+
+    Build(items, begin, mid, bitTrail, depth + 1);
+    int child1 = Build(items, mid, end, bitTrail | (uint64_t(1) << depth), depth + 1);
+    nodes[index].child1 = child1;
+    return index;
+}
+
+int BVHLightSampler::Choose(const glm::vec3& p, const glm::vec3& n, float u, float& pmf) const {
+    if (nodes.empty())
+        return -1;
+
+    int index = 0;
+    pmf = 1;
+    for (;;) {
+        const Node& node = nodes[index];
+        if (node.light >= 0) {
+            if (index > 0 || node.bounds.Importance(p, n) > 0)
+                return node.light;
+            return -1;
+        }
+
+        float ci0 = nodes[index + 1].bounds.Importance(p, n);
+        float ci1 = nodes[node.child1].bounds.Importance(p, n);
+        if (ci0 == 0 && ci1 == 0)
+            return -1;
+
+        // reuse u for the next level after remapping it to [0, 1)
+        float p0 = ci0 / (ci0 + ci1);
+        if (u < p0) {
+            index = index + 1;
+            u = std::min(u / p0, 0.99999994f);
+            pmf *= p0;
+        } else {
+            index = node.child1;
+            u = std::min((u - p0) / (1 - p0), 0.99999994f);
+            pmf *= 1 - p0;
+        }
+    }
+}
+
+float BVHLightSampler::Pmf(const glm::vec3& p, const glm::vec3& n, int light) const {
+    if (nodes.empty())
+        return 0;
+
+    uint64_t bitTrail = bitTrails[light];
+    int index = 0;
+    float pmf = 1;
+    for (;;) {
+        const Node& node = nodes[index];
+        if (node.light >= 0)
+            return node.light == light ? pmf : 0;
+
+        float ci0 = nodes[index + 1].bounds.Importance(p, n);
+        float ci1 = nodes[node.child1].bounds.Importance(p, n);
+        if (ci0 == 0 && ci1 == 0)
+            return 0;
+
+        if (bitTrail & 1) {
+            pmf *= ci1 / (ci0 + ci1);
+            index = node.child1;
+        } else {
+            pmf *= ci0 / (ci0 + ci1);
+            index = index + 1;
+        }
+        bitTrail >>= 1;
+    }
+}
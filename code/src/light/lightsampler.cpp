@@ -0,0 +1,76 @@
+#include <thinlens/light/lightsampler.h>
+#include <thinlens/light/lightbvh.h>
+
+#define PI 3.141592653589793238462643383279502884
+
+LightSampler::LightSampler(const std::vector<Triangle>& triangles)
+    : triangles(triangles), lightIndex(triangles.size(), -1)
+{
+    for (size_t i = 0; i < triangles.size(); ++i) {
+        if (triangles[i].IsEmissive()) {
+            lightIndex[i] = int(lights.size());
+            lights.push_back(int(i));
+        }
+    }
+}
+
+LightSampler::~LightSampler() {}
+
+bool LightSampler::Sample(const glm::vec3& p, const glm::vec3& n, float uLight, const glm::vec2& uPoint, LightSample& ls) const {
+    float pmf;
+    int light = Choose(p, n, uLight, pmf);
+    if (light < 0 || pmf == 0)
+        return false;
+
+    const Triangle& t = triangles[lights[light]];
+    ls.position = t.SamplePoint(uPoint);
+    ls.normal = t.normal;
+    ls.emittance = t.emittance;
+    ls.pdf = pmf / t.Area();
+    ls.triangleIndex = lights[light];
+    return true;
+}
+
+float LightSampler::Pdf(const glm::vec3& p, const glm::vec3& n, int triangleIndex) const {
+    int light = lightIndex[triangleIndex];
+    if (light < 0)
+        return 0;
+    return Pmf(p, n, light) / triangles[triangleIndex].Area();
+}
+
+float LightPower(const Triangle& triangle) {
+    glm::vec3 Le = triangle.emittance;
+    float luminance = 0.2126f * Le.r + 0.7152f * Le.g + 0.0722f * Le.b;
+    return float(PI) * triangle.Area() * luminance;
+}
+
+PowerLightSampler::PowerLightSampler(const std::vector<Triangle>& triangles, bool uniform)
+    : LightSampler(triangles)
+{
+    std::vector<float> weights;
+    for (int t : lights)
+        weights.push_back(uniform ? 1 : LightPower(triangles[t]));
+
+    if (!weights.empty())
+        table = AliasTable(weights);
+}
+
+int PowerLightSampler::Choose(const glm::vec3& /* p */, const glm::vec3& /* n */, float u, float& pmf) const {
+    if (table.Size() == 0)
+        return -1;
+    return table.Sample(u, pmf);
+}
+
+float PowerLightSampler::Pmf(const glm::vec3& /* p */, const glm::vec3& /* n */, int light) const {
+    return table.Pmf(light);
+}
+
+LightSampler* MakeLightSampler(const std::string& name, const std::vector<Triangle>& triangles) {
+    if (name == "uniform")
+        return new PowerLightSampler(triangles, true);
+    if (name == "power")
+        return new PowerLightSampler(triangles);
+    if (name == "bvh")
+        return new BVHLightSampler(triangles);
+    return nullptr;
+}
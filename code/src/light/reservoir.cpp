@@ -0,0 +1,45 @@
+#include <thinlens/light/reservoir.h>
+
+#include <cmath>
+
+#define PI 3.141592653589793238462643383279502884
+
+bool Reservoir::Update(const LightSample& candidate, float w, float u) {
+    weightSum += w;
+    M += 1;
+    if (w > 0 && u * weightSum < w) {
+        sample = candidate;
+        return true;
+    }
+    return false;
+}
+
+bool Reservoir::Merge(const Reservoir& r, float targetPdf, float u) {
+    float m = M;
+    bool replaced = Update(r.sample, targetPdf * r.W * r.M, u);
+    M = m + r.M;
+    return replaced;
+}
+
+void Reservoir::Finalize(float targetPdf) {
+    W = targetPdf > 0 && M > 0 ? weightSum / (M * targetPdf) : 0;
+}
+
+glm::vec3 UnshadowedLight(const glm::vec3& p, const glm::vec3& n, const glm::vec3& albedo, const LightSample& s) {
+    glm::vec3 toLight = s.position - p;
+    float dist2 = glm::dot(toLight, toLight);
+    if (dist2 == 0)
+        return glm::vec3(0, 0, 0);
+
+    glm::vec3 wi = toLight / std::sqrt(dist2);
+    float cosSurface = glm::dot(wi, n);
+    float cosLight = -glm::dot(wi, s.normal);
+    if (cosSurface <= 0 || cosLight <= 0)
+        return glm::vec3(0, 0, 0);
+    return albedo / float(PI) * s.emittance * (cosSurface * cosLight / dist2);
+}
+
+float TargetPdf(const glm::vec3& p, const glm::vec3& n, const glm::vec3& albedo, const LightSample& s) {
+    glm::vec3 L = UnshadowedLight(p, n, albedo, s);
+    return 0.2126f * L.r + 0.7152f * L.g + 0.0722f * L.b;
+}
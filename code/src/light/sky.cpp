@@ -0,0 +1,193 @@
+#include <thinlens/light/sky.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define PI 3.141592653589793238462643383279502884
+
+namespace {
+    // resolution of the sky table; the sun is not in it, so it can be coarse
+    const int TABLE_WIDTH = 512;
+    const int TABLE_HEIGHT = 256;
+    // angular radius of the sun, in radians
+    const float SUN_RADIUS = 0.00465f;
+    // luminance of the sun outside the atmosphere, in kcd/m^2
+    const float SUN_LUMINANCE = 1.9e6f;
+    // wavelengths of the red, green and blue channels, in micrometres
+    const float WAVELENGTHS[3] = { 0.68f, 0.55f, 0.44f };
+    const float GROUND_ALBEDO = 0.2f;
+
+    float Luminance(const glm::vec3& c) {
+        return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+    }
+
+    glm::vec3 Direction(float theta, float phi) {
+        return glm::vec3(std::sin(theta) * std::cos(phi), -std::cos(theta), std::sin(theta) * std::sin(phi));
+    }
+
+    // the Perez sky luminance distribution, relative to the zenith
+    struct Perez {
+        float A, B, C, D, E;
+
+        float operator()(float cosTheta, float gamma) const {
+            float cosGamma = std::cos(gamma);
+            return (1 + A * std::exp(B / std::max(cosTheta, 0.01f)))
+                 * (1 + C * std::exp(D * gamma) + E * cosGamma * cosGamma);
+        }
+    };
+
+    glm::vec3 XyYToRGB(float x, float y, float Y) {
+        if (y <= 0)
+            return glm::vec3(0, 0, 0);
+        float X = x / y * Y;
+        float Z = (1 - x - y) / y * Y;
+        glm::vec3 rgb(3.2406f * X - 1.5372f * Y - 0.4986f * Z,
+                      -0.9689f * X + 1.8758f * Y + 0.0415f * Z,
+                      0.0557f * X - 0.2040f * Y + 1.0570f * Z);
+        return glm::max(rgb, glm::vec3(0, 0, 0));
+    }
+
+    glm::vec3 SunDirection(float elevation, float azimuth) {
+        return Direction(float(PI) / 2 - elevation * float(PI) / 180, azimuth * float(PI) / 180);
+    }
+
+    /*
+        The sun seen through the air mass at its zenith angle
+        (Kasten and Young), dimmed by Rayleigh scattering and
+        by aerosols (Angstrom's formula, with the turbidity
+        relation of Preetham et al.).
+    */
+    glm::vec3 SunRadiance(float turbidity, float elevation, float scale) {
+        if (elevation <= 0)
+            return glm::vec3(0, 0, 0);
+        float thetaDegrees = 90 - elevation;
+        float airMass = 1 / (std::cos(thetaDegrees * float(PI) / 180)
+                             + 0.50572f * std::pow(96.07995f - thetaDegrees, -1.6364f));
+
+        float beta = 0.04608f * turbidity - 0.04586f;
+        glm::vec3 radiance;
+        for (int c = 0; c < 3; ++c) {
+            float rayleigh = 0.008735f * std::pow(WAVELENGTHS[c], -4.08f);
+            float aerosol = beta * std::pow(WAVELENGTHS[c], -1.3f);
+            radiance[c] = std::exp(-airMass * (rayleigh + aerosol));
+        }
+        return radiance * (SUN_LUMINANCE * scale);
+    }
+
+    /*
+        Radiance of the sky (above the horizon) and of the
+        ground (below it) at the centres of the pixels of the
+        table.
+    */
+    std::vector<glm::vec3> SkyTable(float T, const glm::vec3& sun, const glm::vec3& sunRadiance,
+                                    float sunSolidAngle, float scale) {
+        float thetaSun = std::acos(-sun.y);
+
+        // distributions of luminance and chromaticity (x, y)
+        Perez perezY = { 0.1787f * T - 1.4630f, -0.3554f * T + 0.4275f, -0.0227f * T + 5.3251f,
+                         0.1206f * T - 2.5771f, -0.0670f * T + 0.3703f };
+        Perez perezX = { -0.0193f * T - 0.2592f, -0.0665f * T + 0.0008f, -0.0004f * T + 0.2125f,
+                         -0.0641f * T - 0.8989f, -0.0033f * T + 0.0452f };
+        Perez perezy = { -0.0167f * T - 0.2608f, -0.0950f * T + 0.0092f, -0.0079f * T + 0.2102f,
+                         -0.0441f * T - 1.6537f, -0.0109f * T + 0.0529f };
+
+        // at the zenith
+        float chi = (4.f / 9 - T / 120) * (float(PI) - 2 * thetaSun);
+        float zenithY = (4.0453f * T - 4.9710f) * std::tan(chi) - 0.2155f * T + 2.4192f;
+        float t2 = thetaSun * thetaSun;
+        float t3 = t2 * thetaSun;
+        float zenithX = T * T * (0.00166f * t3 - 0.00375f * t2 + 0.00209f * thetaSun)
+                      + T * (-0.02903f * t3 + 0.06377f * t2 - 0.03202f * thetaSun + 0.00394f)
+                      + (0.11693f * t3 - 0.21196f * t2 + 0.06052f * thetaSun + 0.25886f);
+        float zenithy = T * T * (0.00275f * t3 - 0.00610f * t2 + 0.00317f * thetaSun)
+                      + T * (-0.04214f * t3 + 0.08970f * t2 - 0.04153f * thetaSun + 0.00516f)
+                      + (0.15346f * t3 - 0.26756f * t2 + 0.06670f * thetaSun + 0.26688f);
+
+        // irradiance of the ground, from the sky and the sun
+        glm::vec3 irradiance = sunRadiance * sunSolidAngle * std::max(0.f, -sun.y);
+
+        std::vector<glm::vec3> table(TABLE_WIDTH * TABLE_HEIGHT);
+        float pixelSolidAngle = 2 * float(PI) * float(PI) / (TABLE_WIDTH * TABLE_HEIGHT);
+        for (int y = 0; y < TABLE_HEIGHT / 2; ++y) {
+            float theta = (y + 0.5f) / TABLE_HEIGHT * float(PI);
+            float cosTheta = std::cos(theta);
+            for (int x = 0; x < TABLE_WIDTH; ++x) {
+                glm::vec3 w = Direction(theta, (x + 0.5f) / TABLE_WIDTH * 2 * float(PI));
+                float gamma = std::acos(std::max(-1.f, std::min(1.f, glm::dot(w, sun))));
+
+                float Y = zenithY * perezY(cosTheta, gamma) / perezY(1, thetaSun);
+                float cx = zenithX * perezX(cosTheta, gamma) / perezX(1, thetaSun);
+                float cy = zenithy * perezy(cosTheta, gamma) / perezy(1, thetaSun);
+                glm::vec3 L = XyYToRGB(cx, cy, std::max(Y, 0.f)) * scale;
+
+                table[y * TABLE_WIDTH + x] = L;
+                irradiance += L * (cosTheta * std::sin(theta) * pixelSolidAngle);
+            }
+        }
+
+        glm::vec3 ground = irradiance * (GROUND_ALBEDO / float(PI));
+        for (int y = TABLE_HEIGHT / 2; y < TABLE_HEIGHT; ++y)
+            for (int x = 0; x < TABLE_WIDTH; ++x)
+                table[y * TABLE_WIDTH + x] = ground;
+        return table;
+    }
+};
+
+SkyEnvironment::SkyEnvironment(float turbidity, float sunElevation, float sunAzimuth, float scale)
+    : sunDirection(SunDirection(sunElevation, sunAzimuth)),
+      sunRadiance(SunRadiance(turbidity, sunElevation, scale)),
+      sunCosMax(std::cos(SUN_RADIUS)),
+      // 1 - cos(r) = 2 sin^2(r / 2), without cancellation
+      sunSolidAngle(4 * float(PI) * std::pow(std::sin(SUN_RADIUS / 2), 2.f)),
+      sky(SkyTable(turbidity, sunDirection, sunRadiance, sunSolidAngle, scale), TABLE_WIDTH, TABLE_HEIGHT, 1)
+{
+    float sunPower = Luminance(sunRadiance) * sunSolidAngle;
+    float skyPower = sky.MeanLuminance() * 4 * float(PI);
+    sunProbability = sunPower + skyPower > 0 ? sunPower / (sunPower + skyPower) : 0;
+}
+
+glm::vec3 SkyEnvironment::Le(const glm::vec3& w) const {
+    glm::vec3 L = sky.Le(w);
+    if (glm::dot(w, sunDirection) >= sunCosMax)
+        L += sunRadiance;
+    return L;
+}
+
+float SkyEnvironment::SunPdf(const glm::vec3& w) const {
+    return glm::dot(w, sunDirection) >= sunCosMax ? 1 / sunSolidAngle : 0;
+}
+
+glm::vec3 SkyEnvironment::Sample(const glm::vec2& u, glm::vec3& w, float& pdf) const {
+    glm::vec2 v = u;
+    if (v.x < sunProbability) {
+        // uniformly within the cone of the sun
+        v.x /= sunProbability;
+        float oneMinusCos = v.x * sunSolidAngle / (2 * float(PI));
+        float cosTheta = 1 - oneMinusCos;
+        float sinTheta = std::sqrt(std::max(0.f, oneMinusCos * (2 - oneMinusCos)));
+        float phi = 2 * float(PI) * v.y;
+
+        glm::vec3 t = std::abs(sunDirection.x) > 0.1f ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+        t = glm::normalize(glm::cross(t, sunDirection));
+        glm::vec3 b = glm::cross(sunDirection, t);
+        w = glm::normalize(sinTheta * std::cos(phi) * t + sinTheta * std::sin(phi) * b + cosTheta * sunDirection);
+    } else {
+        v.x = std::min((v.x - sunProbability) / (1 - sunProbability), 0.99999994f);
+        float skyPdf;
+        sky.Sample(v, w, skyPdf);
+    }
+
+    pdf = Pdf(w);
+    if (pdf == 0)
+        return glm::vec3(0, 0, 0);
+    return Le(w);
+}
+
+float SkyEnvironment::Pdf(const glm::vec3& w) const {
+    return sunProbability * SunPdf(w) + (1 - sunProbability) * sky.Pdf(w);
+}
+
+float SkyEnvironment::MeanLuminance() const {
+    return sky.MeanLuminance() + Luminance(sunRadiance) * sunSolidAngle / (4 * float(PI));
+}
@@ -1,6 +1,11 @@
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <mutex>
 #include <random>
 #include <sstream>
+#include <thread>
 
 #include <bmp/bmp.h>
 
@@ -8,7 +13,23 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 
+#include <thinlens/cache/radiancecache.h>
 #include <thinlens/camera/perspective.h>
+#include <thinlens/film/aovs.h>
+#include <thinlens/film/checkpoint.h>
+#include <thinlens/film/denoiser.h>
+#include <thinlens/film/film.h>
+#include <thinlens/guiding/sdtree.h>
+#include <thinlens/light/aliastable.h>
+#include <thinlens/light/environment.h>
+#include <thinlens/light/lightsampler.h>
+#include <thinlens/light/reservoir.h>
+#include <thinlens/light/sky.h>
+#include <thinlens/photon/photonmap.h>
+#include <thinlens/render/arena.h>
+#include <thinlens/render/tiles.h>
+#include <thinlens/sampler/sampler.h>
+#include <thinlens/scene/scene.h>
 #include <thinlens/auxiliaries/TestModel.h>
 #include <thinlens/auxiliaries/utility.h>
 
@@ -21,10 +42,15 @@ using glm::mat3;
 // ----------------------------------------------------------------------------
 // GLOBAL VARIABLES
 
-/* Screen variables */
-const int SCREEN_WIDTH = 480;
-const int SCREEN_HEIGHT = 240;
-bitmap_image image(SCREEN_WIDTH, SCREEN_HEIGHT);
+/* 
+    Screen variables: the resolution of the frame, and the 
+    window of it that is rendered and written out (all of it
+    unless --crop is given).
+*/
+int screenWidth = 480;
+int screenHeight = 240;
+CropWindow crop = { 0, 0, 0, 0 };
+bitmap_image image; // the whole frame
 
 /* Time */
 int t;
@@ -41,8 +67,76 @@ mat3 R; // Y * P
 mat3 Y; // Yaw rotation matrix (around y axis)
 mat3 P; // Pitch rotation matrix (around x axis)
 
-/* Model */
+/* 
+    Model: the triangles as loaded, which the lights are 
+    sampled from, and the scene that rays are traced and
+    surfaces shaded in (with the same triangle indices, and
+    the triangles of a --model mesh after them).
+*/
 vector<Triangle> triangles;
+Scene scene;
+int ceilingLights = 0; // n x n grid of area lights below the ceiling
+const float MODEL_SIZE = 1.f; // largest side of a loaded mesh; the room is 2 across
+const Material MODEL_MATERIAL = { vec3(0.75f, 0.75f, 0.75f), vec3(0, 0, 0) };
+LightSampler* lightSampler = nullptr; // nullptr disables next-event estimation
+
+/* 
+    Russian roulette: from rrDepth bounces on, paths survive 
+    each bounce with a probability and are reweighted by its 
+    inverse, which ends paths that carry little light without
+    biasing the image. Throughput uses the path throughput as
+    survival probability. Efficiency compares the light the 
+    path is expected to carry (its throughput times the mean 
+    radiance of the image) with the current estimate of the 
+    pixel, so paths are ended sooner in pixels where they 
+    would barely make a difference.
+*/
+enum class Roulette { None, Throughput, Efficiency };
+Roulette roulette = Roulette::Throughput;
+int rrDepth = 3;
+float imageMean = 0; // luminance, updated after every pass
+
+/* 
+    Sampling. Every pixel sample uses the dimensions of the
+    sampler in the same way: pixel jitter (2), lens (2), then
+    per bounce light choice (1), point on light (2), bounce
+    direction (2), Russian roulette (1) and environment 
+    direction (2).
+*/
+Sampler* samplerPrototype = nullptr; // cloned for every tile
+const int CAMERA_DIMENSIONS = 4;
+const int BOUNCE_DIMENSIONS = 8;
+
+/* Statistics */
+atomic<uint64_t> pathCount(0);
+atomic<uint64_t> pathSegments(0);
+
+/* 
+    Integrators. Path traces paths from the camera only 
+    (TracePath). BDPT also traces a path from the lights for 
+    every camera sample and connects every vertex of the one
+    to every vertex of the other (TraceBidirectional); light
+    path vertices that are connected straight to the camera 
+    land on other pixels and are splatted to the film.
+*/
+enum class Integrator { Path, BDPT };
+Integrator integrator = Integrator::Path;
+
+/* 
+    Everything around the scene emits this: a constant sky,
+    an HDR environment map or an analytic sky and sun. 
+    Directions of the latter two are also sampled at every
+    vertex, like the lights, and combined with the bounces
+    by MIS; the constant sky is found well enough by the 
+    bounces alone.
+*/
+Environment* environment = nullptr;
+bool sampleEnvironment = false;
+const float SKY_UNITS = 0.05f; // radiance of the model per kcd/m^2 of the analytic sky
+
+/* How light sampling and BSDF sampling of emitters are combined */
+enum class MIS { None, Balance, Power };
+MIS mis = MIS::Power; // None: emitters are only found by light sampling
 
 /* Light source */
 vec3 lightPos( 0, -0.5, -0.7 );
@@ -50,28 +144,311 @@ vec3 lightColor = 14.f * vec3( 1, 1, 1 );
 vec3 indirectLight = 0.5f*vec3( 1, 1, 1 );
 
 /* Path Tracing Parameters */
-int maxDepth;
+int maxDepth; // 0 on the command line: no limit, only Russian roulette ends paths
 int numSamples;
-vec3 buffer[SCREEN_WIDTH][SCREEN_HEIGHT];
+Film film(0, 0);
+mutex filmMutex; // serialises Film::MergeTile, tiles overlap by the filter radius
+
+/*
+    Reconstruction filter of the film; a radius of 0 takes 
+    the default radius of the filter (see DefaultFilterRadius).
+*/
+FilterType filterType = FilterType::Box;
+float filterRadius = 0;
+
+/* 
+    Firefly suppression, all off by default as they trade 
+    bias for less noise. maxContribution clamps the 
+    luminance of what every vertex after the first adds to
+    a path. regularizeDistance bounds the inverse-square 
+    falloff of light sampling after the first bounce, as if 
+    lights were never closer than that. filmBuckets > 1 
+    makes the film a median-of-means estimator (see Film).
+*/
+float maxContribution = 0; // 0 for no clamping
+float regularizeDistance = 0;
+int filmBuckets = 1;
+
+/* 
+    Adaptive sampling: after adaptiveMinSamples passes, only
+    tiles in which some pixel's relative error (see 
+    Film::RelativeError) is above adaptiveThreshold get more
+    samples, and numSamples becomes the most any pixel gets.
+    Independently, the render stops early once the mean 
+    relative error of all pixels is below noiseTarget.
+*/
+float adaptiveThreshold = 0; // 0 samples every pixel numSamples times
+int adaptiveMinSamples = 16;
+float noiseTarget = 0; // 0 for no target
+
+/* Output */
+ResolveSettings resolveSettings;
+double previewInterval = 0; // seconds between previews, 0 for none
+string sppMapPath; // grey image of the samples per pixel, empty for none
+
+/* 
+    Denoising. The albedo, normal and depth buffers that guide
+    the denoiser get a pass of their own after the render,
+    which only traces camera rays (AOV_SAMPLES per pixel).
+*/
+bool denoise = false;
+bool writeAOVs = false; // albedo.bmp, normal.bmp and depth.bmp
+DenoiseSettings denoiseSettings;
+AOVBuffer* aovs = nullptr; // nullptr unless denoising or writing AOVs
+const int AOV_SAMPLES = 16;
+const float SKY_DEPTH = 10; // far plane of the camera
+
+/* Checkpointing */
+uint64_t seed;
+/*
+    Passes are numbered by the samples a pixel has: in pass i
+    only pixels with at most i samples get one more, so pixels
+    a crop window (or adaptive sampling) left behind catch up
+    when they are rendered again, and no pixel goes past the
+    sample count asked for. startSample is the fewest samples
+    of any pixel of the crop window when the render starts.
+    Checkpoints record the fewest samples of any pixel of the
+    whole frame.
+*/
+int startSample = 0;
+int currentPass = 0;
+atomic<uint64_t> passSamples(0); // pixel samples taken in the current pass
+CheckpointWriter* checkpoint = nullptr;
+double checkpointInterval = 60; // seconds between checkpoints
+
+/* 
+    Bidirectional path tracing. Light paths start on an 
+    emitter or on the sky, chosen by power. The vertices of
+    both subpaths live in a per-thread arena that is reset
+    for every sample. When max-depth is left to Russian 
+    roulette, subpaths are cut off at BDPT_MAX_DEPTH.
+*/
+struct PathVertex;
+struct Splat {
+	int x, y;
+	vec3 L;
+};
+const int BDPT_MAX_DEPTH = 64;
+vector<int> emitters; // triangle indices; the sky is the emitter after the last one
+vector<int> emitterIndex; // per triangle, -1 if it does not emit
+AliasTable emitterTable;
+vec3 sceneCenter;
+float sceneRadius;
+vector<vector<Splat>> tileSplats; // per tile index, added to the film after every pass
+thread_local MemoryArena arena;
+
+/* 
+    Path guiding (path integrator only). Training happens in
+    iterations of 1, 2, 4, ... passes: paths record the 
+    radiance they find into the building trees of guide, 
+    and at the end of every iteration these become the 
+    distributions that bounces sample from, half of the 
+    time (the other half samples the BRDF). Training stops 
+    when fewer than twice the passes of the next iteration
+    are left; the remaining passes use what was learned.
+*/
+struct GuideRecord {
+	int leaf;
+	vec3 wi;
+	float pdf;  // of the bounce that chose wi
+	vec3 beta;  // path throughput after the bounce
+	vec3 L;     // radiance found along wi
+};
+SDTree* guide = nullptr; // nullptr disables guiding
+bool guideTraining = false;
+int guideIteration = 0;
+int guideIterationEnd = 1; // passes of this render after which the iteration ends
+const float GUIDE_BSDF_FRACTION = 0.5f;
+const int GUIDE_MAX_VERTICES = 32; // deeper vertices do not record
+
+/* 
+    Photon mapping (path integrator only). Before the first
+    pass, numPhotons light paths (started like those of 
+    BDPT) leave a photon on every surface they reach. The 
+    first bounce of every camera path then ends in a density
+    estimate of the photons around the point it hit (final
+    gathering) instead of going on: biased, but the bias 
+    goes away as the number of photons grows.
+*/
+int numPhotons = 0; // 0 disables photon mapping
+int photonGather = 64; // photons per estimate
+const float PHOTON_RADIUS = 0.05f; // largest gather radius, in scene radii
+PhotonMap* photonMap = nullptr;
+
+/* 
+    Radiance cache (path integrator only; biased). Every 
+    path adds the radiance it found leaving each of its 
+    vertices to a hash grid over the scene, and paths end at
+    vertex cacheDepth (1 after the first bounce, 2 after the
+    second) on the radiance cached for the cell they hit, 
+    once it has CACHE_MIN_SAMPLES samples.
+*/
+struct CacheRecord {
+	vec3 p;
+	vec3 n;
+	vec3 beta;  // path throughput when arriving here
+	vec3 L;     // radiance leaving towards the previous vertex, without emission
+};
+RadianceCache* radianceCache = nullptr;
+int cacheDepth = 0; // 0 disables the cache
+int cacheResolution = 128; // cells along the diagonal of the scene
+int cacheMemory = 64; // megabytes
+const uint32_t CACHE_MIN_SAMPLES = 8;
+const int CACHE_MAX_VERTICES = 32; // deeper vertices are not cached
+
+/* 
+    ReSTIR direct lighting (path integrator only). Before 
+    every pass, each pixel resamples RESTIR_CANDIDATES light
+    samples for the first surface it sees into a reservoir,
+    which keeps its sample only if it is visible. During the
+    pass, every pixel merges its reservoir with those of up
+    to RESTIR_NEIGHBOURS pixels nearby that see a similar 
+    surface, and the first vertex of its path takes its 
+    direct light from the merged reservoir instead of from 
+    light sampling. Biased: merged reservoirs are not 
+    reweighted by which pixels could have produced their 
+    samples, which darkens the edges of shadows a little.
+*/
+struct ReservoirPixel {
+	bool hit;
+	vec3 p;
+	vec3 n; // facing the camera
+	vec3 albedo;
+	float depth;
+	int pass; // in which the reservoir was filled
+	Reservoir reservoir;
+};
+bool restir = false;
+vector<ReservoirPixel> reservoirs;
+Sampler* restirSampler = nullptr; // candidates and neighbours
+const int RESTIR_CANDIDATES = 32;
+const int RESTIR_NEIGHBOURS = 5;
+const float RESTIR_RADIUS = 30; // pixels
+const int RESTIR_REUSE_DIMENSION = 4 * RESTIR_CANDIDATES;
+
+/* 
+    Primary-ray splitting (path integrator only). Every 
+    camera ray that hits a surface is followed by splitCount
+    paths from that hit instead of one, each weighted by 
+    1 / splitCount: the pixel and lens samples and the first
+    intersection are paid for once, while the light that
+    arrives at the first hit is averaged over more paths. 
+    The first path takes the random numbers of the pixel
+    sample, the others come from splitSampler. With 
+    adaptiveSplit, pixels whose neighbourhood is less noisy
+    than twice the mean relative error of the image get 
+    proportionally fewer paths. The counts are worked out into
+    splitMap between passes, as the errors of neighbouring
+    pixels change while a pass is being rendered.
+*/
+int splitCount = 1;
+bool adaptiveSplit = false;
+Sampler* splitSampler = nullptr;
+float meanRelativeError = 0; // updated after every pass with adaptiveSplit
+vector<uint8_t> splitMap;      // paths per sample of every pixel, for the next pass
+const int MAX_SPLIT = 64;
+const int SPLIT_MIN_SAMPLES = 4; // before this, every pixel gets splitCount paths
+
+/* Scheduling */
+int numThreads = max(1u, thread::hardware_concurrency());
+int tileSize = 16;
+TileOrder tileOrder = TileOrder::Spiral;
 
 // ----------------------------------------------------------------------------
 // FUNCTIONS
 
 void Update();
 void Draw();
+void RenderTile(const Camera* c, const Tile& tile);
+void RenderAOVTile(const Camera* c, const Tile& tile);
+void RenderReservoirTile(const Camera* c, const Tile& tile);
+void RenderTiles(const Camera* c, const vector<Tile>& tiles, void (*render)(const Camera*, const Tile&));
+vec3 ReSTIRDirect(int x, int y, Sampler& sampler);
+float ConvergenceMap(const vector<Tile>& tiles, vector<Tile>& active);
 bool ClosestIntersection(
 	vec3 start, 
 	vec3 dir,
-	const vector<Triangle>& triangles, 
+	const Scene& scene, 
 	Intersection& closestIntersection 
 );
+bool Occluded(vec3 start, vec3 end, const Scene& scene);
+bool OccludedRay(vec3 start, vec3 dir, const Scene& scene);
 
-vec3 TracePath(Ray &r, int depth);
+vec3 TracePath(Ray r, Sampler& sampler, float pixelEstimate, int& segments, const Intersection* firstHit = nullptr);
+vec3 TraceSplit(const Ray& r, int x, int y, int n, Sampler& sampler, Sampler& splits, int& segments);
+int SplitCount(int x, int y);
+void UpdateSplitMap();
+float SurvivalProbability(const vec3& beta, float pixelEstimate);
+float MISWeight(float pdf, float otherPdf);
+float BouncePdf(int leaf, const vec3& normal, const vec3& w);
+void SceneBounds(vec3& pMin, vec3& pMax);
+void PlaceModel(Mesh& mesh);
+void SaveImage(const bitmap_image& frame, const string& path);
+
+void InitLightPaths();
+void EmitPhotons();
+vec3 TraceBidirectional(const Camera* c, const Ray& r, Sampler& sampler, vector<Splat>& splats, int& segments);
+vec3 ClampContribution(const vec3& contribution, int depth);
+
+
+void Usage(const char* program){
+    cerr << "Correct usage: " << program << " <max-depth> <num-samples> [options]" << endl;
+    cerr << "(a max-depth of 0 leaves the length of paths to Russian roulette)" << endl;
+    cerr << "options:" << endl;
+    cerr << "  --seed <n>                  seed of the random number engine" << endl;
+    cerr << "  --resolution <w>x<h>        size of the frame in pixels (default 480x240)" << endl;
+    cerr << "  --crop <x0>,<y0>,<x1>,<y1>  only render and write the pixels [x0, x1) x [y0, y1)" << endl;
+    cerr << "  --checkpoint <file>         periodically save the film to file" << endl;
+    cerr << "  --checkpoint-interval <s>   seconds between checkpoints (default 60)" << endl;
+    cerr << "  --resume <file>             continue a render from a checkpoint" << endl;
+    cerr << "  --preview-interval <s>      write output.bmp every s seconds while rendering" << endl;
+    cerr << "  --exposure <e>              scale radiance before tone mapping (default 1)" << endl;
+    cerr << "  --tonemap <curve>           none, reinhard or aces (default none)" << endl;
+    cerr << "  --srgb                      encode output with the sRGB curve" << endl;
+    cerr << "  --spp-map <file>            also write the samples per pixel as a grey image" << endl;
+    cerr << "  --denoise                   filter the output, guided by albedo, normals and depth" << endl;
+    cerr << "                              (the unfiltered image is kept as output_noisy.bmp)" << endl;
+    cerr << "  --denoise-iterations <n>    filter passes, each doubling the radius (default 5)" << endl;
+    cerr << "  --aovs                      also write albedo.bmp, normal.bmp and depth.bmp" << endl;
+    cerr << "  --adaptive <error>          stop sampling tiles whose pixels are below this relative error" << endl;
+    cerr << "  --adaptive-min <n>          samples per pixel before sampling becomes adaptive (default 16)" << endl;
+    cerr << "  --noise-target <error>      stop once the mean relative error is below this" << endl;
+    cerr << "  --lights <n>                add an n x n grid of area lights to the model" << endl;
+    cerr << "  --model <file>              place a Wavefront OBJ mesh on the floor of the room" << endl;
+    cerr << "  --environment <file>        light the scene with a latitude-longitude RGBE (.hdr) map" << endl;
+    cerr << "  --environment-scale <s>     multiply the radiance of the map or sky (default 1)" << endl;
+    cerr << "  --sky <turbidity>           light the scene with an analytic sky and sun (turbidity 2 to 10)" << endl;
+    cerr << "  --sun-elevation <degrees>   height of the sun above the horizon (default 55)" << endl;
+    cerr << "  --sun-azimuth <degrees>     direction of the sun, from +x (0) towards +z (90) (default 250)" << endl;
+    cerr << "  --light-sampler <name>      none, uniform, power or bvh (default power)" << endl;
+    cerr << "  --mis <heuristic>           combine light and BSDF sampling: none, balance or power (default power)" << endl;
+    cerr << "  --rr <mode>                 Russian roulette: none, throughput or efficiency (default throughput)" << endl;
+    cerr << "  --rr-depth <n>              bounces before Russian roulette starts (default 3)" << endl;
+    cerr << "  --integrator <name>         path or bdpt (bidirectional, default path)" << endl;
+    cerr << "  --guiding                   learn where light comes from and sample bounces towards it" << endl;
+    cerr << "  --photons <n>               gather indirect light from a map of photons from n light paths" << endl;
+    cerr << "  --photon-gather <k>         photons per estimate (default 64, at most 256)" << endl;
+    cerr << "  --radiance-cache <depth>    end paths at this vertex (1 or 2) on cached radiance" << endl;
+    cerr << "  --cache-resolution <n>      cells of the cache along the scene diagonal (default 128)" << endl;
+    cerr << "  --cache-memory <mb>         size of the cache in megabytes (default 64)" << endl;
+    cerr << "  --restir                    direct light of the first surface from reservoirs shared by nearby pixels" << endl;
+    cerr << "  --split <n>                 trace n paths from the first hit of every camera ray (at most 64)" << endl;
+    cerr << "  --split-adaptive            fewer paths where the image is less noisy" << endl;
+    cerr << "  --clamp <max>               clamp the luminance each bounce adds to a path (indirect light)" << endl;
+    cerr << "  --regularize <distance>     treat lights as at least this far away after the first bounce" << endl;
+    cerr << "  --median-of-means <k>       film pixels are the median of k partial means (at most 32)" << endl;
+    cerr << "  --filter <name>             reconstruction filter: box, tent, gaussian or mitchell (default box)" << endl;
+    cerr << "  --filter-radius <r>         radius of the filter in pixels (default 0.5, 1, 1.5 and 2 respectively)" << endl;
+    cerr << "  --sampler <name>            independent, stratified, halton, sobol or bluenoise (default sobol)" << endl;
+    cerr << "  --threads <n>               number of render threads (default: all cores)" << endl;
+    cerr << "  --tile-size <n>             width and height of a tile in pixels (default 16)" << endl;
+    cerr << "  --tile-order <order>        spiral (centre first), hilbert or scanline (default spiral)" << endl;
+}
 
 int main( int argc, char* argv[] )
 {
-    if(argc != 3){
-        cerr << "Correct usage: " << argv[0] << " <max-depth> <num-samples>" << endl;
+    if(argc < 3){
+        Usage(argv[0]);
         return -1;
     }
 
@@ -81,9 +458,9 @@ int main( int argc, char* argv[] )
     ss << argv[1] << " " << argv[2];
     ss >> maxDepth;
 
-    if(!ss || maxDepth < 0){
+    if(!ss || maxDepth < 0){
         cerr << "first argument must be a positive integer" << endl;
-        cerr << "Correct usage: " << argv[0] << " <max-depth> <num-samples>" << endl;
+        Usage(argv[0]);
         return -1;
     }
 
@@ -91,10 +468,210 @@ int main( int argc, char* argv[] )
 
     if(!ss || numSamples < 0){
         cerr << "second argument must be a positive integer" << endl;
-        cerr << "Correct usage: " << argv[0] << " <max-depth> <num-samples>" << endl;
+        Usage(argv[0]);
         return -1;
     }
 
+    seed = (uint64_t(rd()) << 32) | rd();
+    string checkpointPath;
+    string resumePath;
+    bool resolutionGiven = false;
+    string lightSamplerName = "power";
+    string environmentPath;
+    string modelPath;
+    float environmentScale = 1;
+    float turbidity = 0; // 0: no analytic sky
+    float sunElevation = 55;
+    float sunAzimuth = 250;
+    string samplerName = "sobol";
+
+    for(int a = 3; a < argc; ++a){
+        string option = argv[a];
+        if(option == "--srgb"){
+            resolveSettings.srgb = true;
+            continue;
+        }
+        if(option == "--denoise"){
+            denoise = true;
+            continue;
+        }
+        if(option == "--aovs"){
+            writeAOVs = true;
+            continue;
+        }
+        if(option == "--restir"){
+            restir = true;
+            continue;
+        }
+        if(option == "--split-adaptive"){
+            adaptiveSplit = true;
+            continue;
+        }
+        if(option == "--guiding"){
+            guideTraining = true;
+            continue;
+        }
+
+        if(a + 1 >= argc){
+            cerr << "missing value for option " << option << endl;
+            Usage(argv[0]);
+            return -1;
+        }
+
+        stringstream value(argv[++a]);
+        if(option == "--seed"){
+            value >> seed;
+        } else if(option == "--checkpoint"){
+            value >> checkpointPath;
+        } else if(option == "--checkpoint-interval"){
+            value >> checkpointInterval;
+        } else if(option == "--resume"){
+            value >> resumePath;
+        } else if(option == "--preview-interval"){
+            value >> previewInterval;
+        } else if(option == "--exposure"){
+            value >> resolveSettings.exposure;
+        } else if(option == "--spp-map"){
+            value >> sppMapPath;
+        } else if(option == "--denoise-iterations"){
+            if(value >> denoiseSettings.iterations && denoiseSettings.iterations < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--adaptive"){
+            if(value >> adaptiveThreshold && adaptiveThreshold < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--adaptive-min"){
+            // errors need at least two samples
+            if(value >> adaptiveMinSamples && adaptiveMinSamples < 2)
+                value.setstate(ios::failbit);
+        } else if(option == "--noise-target"){
+            if(value >> noiseTarget && noiseTarget < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--tonemap"){
+            string name;
+            if(value >> name && !ParseToneMap(name, resolveSettings.toneMap))
+                value.setstate(ios::failbit);
+        } else if(option == "--lights"){
+            if(value >> ceilingLights && ceilingLights < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--model"){
+            value >> modelPath;
+        } else if(option == "--environment"){
+            value >> environmentPath;
+        } else if(option == "--environment-scale"){
+            if(value >> environmentScale && environmentScale < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--split"){
+            if(value >> splitCount && (splitCount < 1 || splitCount > MAX_SPLIT))
+                value.setstate(ios::failbit);
+        } else if(option == "--sky"){
+            if(value >> turbidity && (turbidity < 2 || turbidity > 10))
+                value.setstate(ios::failbit);
+        } else if(option == "--sun-elevation"){
+            if(value >> sunElevation && (sunElevation < 0 || sunElevation > 90))
+                value.setstate(ios::failbit);
+        } else if(option == "--sun-azimuth"){
+            value >> sunAzimuth;
+        } else if(option == "--light-sampler"){
+            value >> lightSamplerName;
+        } else if(option == "--mis"){
+            string name;
+            value >> name;
+            if(name == "none")
+                mis = MIS::None;
+            else if(name == "balance")
+                mis = MIS::Balance;
+            else if(name == "power")
+                mis = MIS::Power;
+            else
+                value.setstate(ios::failbit);
+        } else if(option == "--rr"){
+            string name;
+            value >> name;
+            if(name == "none")
+                roulette = Roulette::None;
+            else if(name == "throughput")
+                roulette = Roulette::Throughput;
+            else if(name == "efficiency")
+                roulette = Roulette::Efficiency;
+            else
+                value.setstate(ios::failbit);
+        } else if(option == "--rr-depth"){
+            if(value >> rrDepth && rrDepth < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--integrator"){
+            string name;
+            value >> name;
+            if(name == "path")
+                integrator = Integrator::Path;
+            else if(name == "bdpt")
+                integrator = Integrator::BDPT;
+            else
+                value.setstate(ios::failbit);
+        } else if(option == "--photons"){
+            if(value >> numPhotons && numPhotons < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--photon-gather"){
+            if(value >> photonGather && (photonGather < 1 || photonGather > PhotonMap::MAX_GATHER))
+                value.setstate(ios::failbit);
+        } else if(option == "--radiance-cache"){
+            if(value >> cacheDepth && (cacheDepth < 1 || cacheDepth > 2))
+                value.setstate(ios::failbit);
+        } else if(option == "--cache-resolution"){
+            if(value >> cacheResolution && cacheResolution < 1)
+                value.setstate(ios::failbit);
+        } else if(option == "--cache-memory"){
+            if(value >> cacheMemory && cacheMemory < 1)
+                value.setstate(ios::failbit);
+        } else if(option == "--clamp"){
+            if(value >> maxContribution && maxContribution < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--regularize"){
+            if(value >> regularizeDistance && regularizeDistance < 0)
+                value.setstate(ios::failbit);
+        } else if(option == "--median-of-means"){
+            if(value >> filmBuckets && (filmBuckets < 1 || filmBuckets > Film::MAX_BUCKETS))
+                value.setstate(ios::failbit);
+        } else if(option == "--filter"){
+            string name;
+            if(value >> name && !ParseFilter(name, filterType))
+                value.setstate(ios::failbit);
+        } else if(option == "--filter-radius"){
+            if(value >> filterRadius && filterRadius < 0.5f)
+                value.setstate(ios::failbit);
+        } else if(option == "--sampler"){
+            value >> samplerName;
+        } else if(option == "--threads"){
+            if(value >> numThreads && numThreads < 1)
+                value.setstate(ios::failbit);
+        } else if(option == "--resolution"){
+            string text;
+            if(value >> text && !ParseResolution(text, screenWidth, screenHeight))
+                value.setstate(ios::failbit);
+            resolutionGiven = true;
+        } else if(option == "--crop"){
+            string text;
+            if(value >> text && !ParseCropWindow(text, crop))
+                value.setstate(ios::failbit);
+        } else if(option == "--tile-size"){
+            if(value >> tileSize && tileSize < 1)
+                value.setstate(ios::failbit);
+        } else if(option == "--tile-order"){
+            string name;
+            if(value >> name && !ParseTileOrder(name, tileOrder))
+                value.setstate(ios::failbit);
+        } else {
+            cerr << "unknown option " << option << endl;
+            Usage(argv[0]);
+            return -1;
+        }
+
+        if(!value){
+            cerr << "invalid value for option " << option << endl;
+            Usage(argv[0]);
+            return -1;
+        }
+    }
+
     if(!cin.eof()){
         if(!(cin >> focalDistance)){
             cerr << "incorrect format of read input" << endl;
@@ -126,15 +703,197 @@ int main( int argc, char* argv[] )
         }
     }
 
-	srand(time(NULL));
+	// a resumed render continues the frame of its checkpoint
+	CheckpointData resumeData;
+	if(!resumePath.empty()){
+		if(!LoadCheckpoint(resumePath, resumeData))
+			return -1;
+		if(!resolutionGiven){
+			screenWidth = resumeData.width;
+			screenHeight = resumeData.height;
+		}
+	}
+
+	// an empty window is the default, the whole frame
+	if(crop.x1 == 0){
+		crop = { 0, 0, screenWidth, screenHeight };
+	} else if(crop.x1 > screenWidth || crop.y1 > screenHeight){
+		cerr << "the crop window must lie within the " << screenWidth << "x" << screenHeight << " frame" << endl;
+		return -1;
+	}
+	image.setwidth_height(screenWidth, screenHeight);
+
+	if(filterRadius == 0)
+		filterRadius = DefaultFilterRadius(filterType);
+	film = Film(screenWidth, screenHeight, filmBuckets, Filter(filterType, filterRadius));
+
+	if(!resumePath.empty()){
+		if(!film.Restore(resumeData))
+			return -1;
+		resumeData.pixels = vector<float>();
+		seed = resumeData.seed;
+		startSample = film.MinSampleCount(crop);
+		cout << "Resuming from " << startSample << " samples" << endl;
+
+		// keep writing to the checkpoint we resumed from unless told otherwise
+		if(checkpointPath.empty())
+			checkpointPath = resumePath;
+	}
+
+	if(!checkpointPath.empty()){
+		checkpoint = new CheckpointWriter(checkpointPath, screenWidth, screenHeight, film.Channels());
+		if(!checkpoint->IsOpen())
+			return -1;
+	}
+
+	if(maxDepth == 0){
+		if(roulette == Roulette::None){
+			cerr << "a max-depth of 0 needs Russian roulette" << endl;
+			return -1;
+		}
+		maxDepth = INT_MAX;
+	}
+
+	samplerPrototype = MakeSampler(samplerName, max(1, numSamples), seed);
+	if(!samplerPrototype){
+		cerr << "unknown sampler " << samplerName << endl;
+		return -1;
+	}
 
 	// load model
 	LoadTestModel(triangles);
+	AddCeilingLights(triangles, ceilingLights, 15.f * vec3(1, 1, 1));
+	if(!modelPath.empty()){
+		vector<Mesh> meshes(1);
+		if(!LoadOBJ(modelPath, meshes[0]))
+			return -1;
+		PlaceModel(meshes[0]);
+		scene = Scene(triangles, meshes, vector<Material>(1, MODEL_MATERIAL));
+		cout << "Scene: " << scene.Size() << " triangles, " << scene.NumVertices() << " vertices ("
+		     << scene.MemoryBytes() / (1024 * 1024) << " MB)" << endl;
+	} else {
+		scene = Scene(triangles);
+	}
+
+	if(lightSamplerName != "none"){
+		lightSampler = MakeLightSampler(lightSamplerName, triangles);
+		if(!lightSampler){
+			cerr << "unknown light sampler " << lightSamplerName << endl;
+			return -1;
+		}
+	}
+
+	if(!environmentPath.empty() && turbidity > 0){
+		cerr << "choose either an environment map or the analytic sky" << endl;
+		return -1;
+	}
+	if(!environmentPath.empty()){
+		environment = LoadEnvironment(environmentPath, environmentScale);
+		if(!environment)
+			return -1;
+		sampleEnvironment = true;
+	} else if(turbidity > 0){
+		environment = new SkyEnvironment(turbidity, sunElevation, sunAzimuth, SKY_UNITS * environmentScale);
+		sampleEnvironment = true;
+	} else {
+		environment = new ConstantEnvironment(0.7f * vec3(1, 1, 1));
+	}
+
+	if(integrator == Integrator::BDPT && mis == MIS::None){
+		cerr << "bidirectional path tracing needs --mis balance or power to weight its strategies" << endl;
+		return -1;
+	}
+
+	if(integrator == Integrator::BDPT || numPhotons > 0)
+		InitLightPaths();
+
+	if(numPhotons > 0){
+		if(integrator != Integrator::Path){
+			cerr << "photon mapping needs the path integrator" << endl;
+			return -1;
+		}
+		EmitPhotons();
+	}
+
+	if(restir){
+		if(integrator != Integrator::Path || !lightSampler){
+			cerr << "ReSTIR needs the path integrator and a light sampler" << endl;
+			return -1;
+		}
+		reservoirs.resize(size_t(screenWidth) * screenHeight);
+		restirSampler = MakeSampler("independent", 1, seed ^ 0x9e3779b97f4a7c15ULL);
+	}
+
+	if(splitCount > 1){
+		if(integrator != Integrator::Path){
+			cerr << "primary-ray splitting needs the path integrator" << endl;
+			return -1;
+		}
+		splitSampler = MakeSampler("independent", 1, seed ^ 0xc2b2ae3d27d4eb4fULL);
+		splitMap.resize(size_t(screenWidth) * screenHeight);
+		UpdateSplitMap();
+	}
+
+	if(cacheDepth > 0){
+		if(integrator != Integrator::Path){
+			cerr << "the radiance cache needs the path integrator" << endl;
+			return -1;
+		}
+		vec3 pMin, pMax;
+		SceneBounds(pMin, pMax);
+		radianceCache = new RadianceCache(glm::length(pMax - pMin) / cacheResolution, size_t(cacheMemory) << 20);
+	}
+
+	if(guideTraining){
+		if(integrator != Integrator::Path){
+			cerr << "guiding needs the path integrator" << endl;
+			return -1;
+		}
+		vec3 pMin, pMax;
+		SceneBounds(pMin, pMax);
+		guide = new SDTree(pMin, pMax);
+	}
+
+	if(denoise || writeAOVs)
+		aovs = new AOVBuffer(screenWidth, screenHeight);
 
     Update();
 	Draw();
 
-	image.save_image("output.bmp" );
+	if(checkpoint){
+		checkpoint->Submit(film.Snapshot(), film.MinSampleCount(), seed);
+		delete checkpoint; // waits for the final checkpoint
+	}
+
+	if(radianceCache)
+		cout << "Radiance cache: " << radianceCache->Cells() << "/" << radianceCache->Capacity() << " cells" << endl;
+
+	if(pathCount > 0)
+		cout << "Mean path length: " << double(pathSegments) / pathCount << " segments" << endl;
+
+	film.Resolve(resolveSettings, image);
+	if(denoise){
+		SaveImage(image, "output_noisy.bmp");
+		Film denoised = Denoise(film, *aovs, denoiseSettings, numThreads);
+		denoised.Resolve(resolveSettings, image);
+	}
+	SaveImage(image, "output.bmp");
+
+	if(writeAOVs){
+		bitmap_image aov(screenWidth, screenHeight);
+		aovs->ResolveAlbedo(aov);
+		SaveImage(aov, "albedo.bmp");
+		aovs->ResolveNormal(aov);
+		SaveImage(aov, "normal.bmp");
+		aovs->ResolveDepth(SKY_DEPTH, aov);
+		SaveImage(aov, "depth.bmp");
+	}
+
+	if(!sppMapPath.empty()){
+		bitmap_image sppMap(screenWidth, screenHeight);
+		film.ResolveSampleCount(sppMap);
+		SaveImage(sppMap, sppMapPath);
+	}
 	return 0;
 }
 
@@ -161,7 +920,7 @@ void Draw()
 
     // scale a "basically unit" image plane according to raster ratio
 	mat2 screenWindow = mat2();
-    float ratio = float(SCREEN_WIDTH)/SCREEN_HEIGHT;
+    float ratio = float(screenWidth)/screenHeight;
 
     screenWindow[0][0] = -ratio;
     screenWindow[0][1] = -1; // bottom left corner of window on image plane in screen space
@@ -170,32 +929,431 @@ void Draw()
     screenWindow[1][1] = 2; // width and height of window on image plane in screen space
 	
 
-	Camera *c = new PerspectiveCamera(cameraToWorld, screenWindow, 0, 10, lensRadius, focalDistance, 50, image);
+	Camera *c = new PerspectiveCamera(cameraToWorld, screenWindow, 0, 10, lensRadius, focalDistance, 50, film);
+
+	auto lastCheckpoint = chrono::steady_clock::now();
+	auto lastPreview = lastCheckpoint;
+
+	imageMean = luminance(film.Mean());
 
-	for(int i = 0; i < numSamples; ++i){
-		
-		cout << "Sample " << (i+1) << "/" << numSamples << endl; 
-		
-		for( int y=0; y<SCREEN_HEIGHT; ++y ){
-			for( int x=0; x<SCREEN_WIDTH; ++x ){
+	// tiles of the whole frame clipped to the crop window, with their indices in the frame
+	vector<Tile> frameTiles = MakeTiles(screenWidth, screenHeight, tileSize, tileOrder);
+	vector<Tile> tiles = CropTiles(frameTiles, crop.x0, crop.y0, crop.x1, crop.y1);
+	vector<Tile> activeTiles = tiles;
+	bool adaptive = adaptiveThreshold > 0 || noiseTarget > 0;
+
+	for(int i = startSample; i < numSamples; ++i){
+
+		// the convergence map only depends on the film, so a resumed render
+		// picks up with the same tiles
+		if(adaptive && i >= adaptiveMinSamples){
+			vector<Tile> converging;
+			float meanError = ConvergenceMap(tiles, converging);
+			if(noiseTarget > 0 && meanError <= noiseTarget){
+				cout << "Reached noise target after " << i << " samples (mean relative error " << meanError << ")" << endl;
+				break;
+			}
+			if(adaptiveThreshold > 0){
+				activeTiles.swap(converging);
+				if(activeTiles.empty()){
+					cout << "All pixels converged after " << i << " samples" << endl;
+					break;
+				}
+			}
+		}
+
+		cout << "Sample " << (i+1) << "/" << numSamples;
+		if(activeTiles.size() < tiles.size())
+			cout << " (" << activeTiles.size() << "/" << tiles.size() << " tiles)";
+		cout << endl;
+
+		if(integrator == Integrator::BDPT && tileSplats.size() != frameTiles.size())
+			tileSplats.resize(frameTiles.size());
+
+		// every pixel's reservoir must be ready before any of its 
+		// neighbours reuse it
+		currentPass = i;
+		if(restir)
+			RenderTiles(c, activeTiles, RenderReservoirTile);
+
+		passSamples = 0;
+		RenderTiles(c, activeTiles, RenderTile);
+
+		// splats are added in tile order, so the sums do not depend on
+		// which thread finished first; a light path was traced per pixel sample
+		if(integrator == Integrator::BDPT){
+			uint64_t lightPaths = passSamples;
+			for(const Tile& tile : tiles){
+				for(const Splat& splat : tileSplats[tile.index])
+					film.AddSplat(splat.x, splat.y, splat.L);
+				tileSplats[tile.index].clear();
+			}
+			film.AddSplatWeight(float(lightPaths) / (float(screenWidth) * screenHeight));
+		}
+
+		if(guideTraining && i + 1 - startSample == guideIterationEnd){
+			guide->Refine(guideIteration);
+			int nextPasses = 1 << (guideIteration + 1);
+			if(numSamples - (i + 1) < 2 * nextPasses)
+				guideTraining = false;
+			++guideIteration;
+			guideIterationEnd += nextPasses;
+			cout << "Guiding: learned from " << guideIteration << (guideIteration > 1 ? " iterations, " : " iteration, ")
+			     << guide->Leaves() << " regions" << (guideTraining ? "" : ", training done") << endl;
+		}
+
+		imageMean = luminance(film.Mean());
+		if(adaptiveSplit && splitCount > 1)
+			UpdateSplitMap();
+
+		// the film is copied here; the write itself happens in the background
+		auto now = chrono::steady_clock::now();
+		if(checkpoint && chrono::duration<double>(now - lastCheckpoint).count() >= checkpointInterval){
+			checkpoint->Submit(film.Snapshot(), film.MinSampleCount(), seed);
+			lastCheckpoint = now;
+		}
+
+		if(previewInterval > 0 && chrono::duration<double>(now - lastPreview).count() >= previewInterval){
+			film.Resolve(resolveSettings, image);
+			SaveImage(image, "output.bmp");
+			lastPreview = now;
+		}
+	}
+
+	if(aovs)
+		RenderTiles(c, tiles, RenderAOVTile);
+}
+
+/*
+    Renders the tiles on numThreads threads. Threads take 
+    tiles in order, so threads running at the same time work
+    on neighbouring tiles.
+*/
+void RenderTiles(const Camera* c, const vector<Tile>& tiles, void (*render)(const Camera*, const Tile&))
+{
+	TileScheduler scheduler(tiles);
+	vector<thread> workers;
+	for(int w = 0; w < numThreads; ++w){
+		workers.push_back(thread([&scheduler, c, render](){
+			Tile tile;
+			while(scheduler.Next(tile))
+				render(c, tile);
+		}));
+	}
+	for(thread& w : workers)
+		w.join();
+}
+
+/*
+    Adds AOV_SAMPLES samples of the first hit to every pixel
+    of the tile, using the same pixel and lens samples as 
+    the render.
+*/
+void RenderAOVTile(const Camera* c, const Tile& tile)
+{
+	Sampler* tileSampler = samplerPrototype->Clone();
+
+	for( int y=tile.y0; y<tile.y1; ++y ){
+		for( int x=tile.x0; x<tile.x1; ++x ){
+			for( int s=0; s<AOV_SAMPLES; ++s ){
+				tileSampler->StartPixelSample(x, y, s);
 
 				CameraSample sample;
-				sample.pFilm = vec2(x + rand() / (float)RAND_MAX, y + rand() / (float)RAND_MAX);
+				sample.pFilm = vec2(x, y) + tileSampler->Get2D();
 				sample.time = 0;
-				sample.pLens = vec2(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+				sample.pLens = tileSampler->Get2D();
 
 				Ray r;
-
 				c->GenerateRay(sample, r);
+				vec3 dir = glm::normalize(vec3(r.d.x, r.d.y, r.d.z));
+
+				// the sky: no albedo to divide out, and a normal that
+				// only changes as slowly as the view direction
+				Intersection i;
+				if(!ClosestIntersection(vec3(r.o.x, r.o.y, r.o.z), dir, scene, i)){
+					aovs->AddSample(x, y, vec3(1, 1, 1), -dir, SKY_DEPTH);
+					continue;
+				}
+
+				vec3 normal = scene.Normal(i.triangleIndex);
+				if(glm::dot(normal, dir) > 0)
+					normal = -normal;
+				aovs->AddSample(x, y, scene.GetMaterial(i.triangleIndex).color, normal, i.distance);
+			}
+		}
+	}
+
+	delete tileSampler;
+}
+
+/*
+    Fills the reservoir of every pixel of the tile with light
+    samples for the first surface the pixel sees, using the 
+    same camera samples as RenderTile (so both see the same
+    surface).
+*/
+void RenderReservoirTile(const Camera* c, const Tile& tile)
+{
+	Sampler* tileSampler = samplerPrototype->Clone();
+	Sampler* candidateSampler = restirSampler->Clone();
+
+	for( int y=tile.y0; y<tile.y1; ++y ){
+		for( int x=tile.x0; x<tile.x1; ++x ){
+			int sampleIndex = film.SampleCount(x, y);
+			tileSampler->StartPixelSample(x, y, sampleIndex);
 
-				vec3 old = buffer[x][y];
-				vec3 color = TracePath(r, 0);
-				buffer[x][y] = (old * float(i) + color)/float(i+1);
-				vec3 bmpColor = glm::clamp(255.f * buffer[x][y], 0, 255);
+			CameraSample sample;
+			sample.pFilm = vec2(x, y) + tileSampler->Get2D();
+			sample.time = 0;
+			sample.pLens = tileSampler->Get2D();
 
-				// cout << "vec4(" << r.d.x << "," << r.d.y << "," << r.d.z << "," << r.d.w << ")" << endl;
-				image.set_pixel(x, y, bmpColor.r, bmpColor.g, bmpColor.b);
+			Ray r;
+			c->GenerateRay(sample, r);
+			vec3 dir = glm::normalize(vec3(r.d.x, r.d.y, r.d.z));
+
+			ReservoirPixel& pixel = reservoirs[size_t(y) * screenWidth + x];
+			pixel.pass = currentPass;
+			pixel.reservoir = Reservoir();
+
+			Intersection i;
+			pixel.hit = ClosestIntersection(vec3(r.o.x, r.o.y, r.o.z), dir, scene, i);
+			if(!pixel.hit)
+				continue;
+
+			vec3 normal = scene.Normal(i.triangleIndex);
+			pixel.p = i.position;
+			pixel.n = glm::dot(normal, dir) < 0 ? normal : -normal;
+			pixel.albedo = scene.GetMaterial(i.triangleIndex).color;
+			pixel.depth = i.distance;
+
+			// resampled importance sampling: candidates from the light
+			// sampler, kept in proportion to the light they bring
+			Reservoir& reservoir = pixel.reservoir;
+			candidateSampler->StartPixelSample(x, y, sampleIndex);
+			for(int k = 0; k < RESTIR_CANDIDATES; ++k){
+				float uLight = candidateSampler->Get1D();
+				vec2 uPoint = candidateSampler->Get2D();
+				float u = candidateSampler->Get1D();
+
+				LightSample ls;
+				if(lightSampler->Sample(pixel.p, pixel.n, uLight, uPoint, ls))
+					reservoir.Update(ls, TargetPdf(pixel.p, pixel.n, pixel.albedo, ls) / ls.pdf, u);
+				else
+					reservoir.M += 1;
 			}
+			reservoir.Finalize(TargetPdf(pixel.p, pixel.n, pixel.albedo, reservoir.sample));
+
+			// neighbours should not pick up samples that are occluded here
+			if(reservoir.W > 0 && Occluded(pixel.p + 1e-4f * pixel.n, reservoir.sample.position, scene))
+				reservoir.W = 0;
+		}
+	}
+
+	delete candidateSampler;
+	delete tileSampler;
+}
+
+/*
+    Direct light from emitters at the first surface pixel 
+    (x, y) sees: its reservoir merged with those of similar
+    pixels nearby, shaded with a shadow ray.
+*/
+vec3 ReSTIRDirect(int x, int y, Sampler& sampler)
+{
+	const ReservoirPixel& center = reservoirs[size_t(y) * screenWidth + x];
+	if(!center.hit || maxDepth < 2)
+		return vec3(0, 0, 0);
+
+	sampler.StartPixelSample(x, y, film.SampleCount(x, y), RESTIR_REUSE_DIMENSION);
+
+	Reservoir r;
+	r.Merge(center.reservoir, TargetPdf(center.p, center.n, center.albedo, center.reservoir.sample), sampler.Get1D());
+	for(int k = 0; k < RESTIR_NEIGHBOURS; ++k){
+		vec2 offset = RESTIR_RADIUS * concentricSampleDisk(sampler.Get2D());
+		float u = sampler.Get1D();
+		int nx = x + int(std::round(offset.x));
+		int ny = y + int(std::round(offset.y));
+		if(nx < crop.x0 || ny < crop.y0 || nx >= crop.x1 || ny >= crop.y1 || (nx == x && ny == y))
+			continue;
+
+		// only surfaces that face the same way at about the same depth
+		const ReservoirPixel& q = reservoirs[size_t(ny) * screenWidth + nx];
+		if(q.pass != currentPass || !q.hit || glm::dot(q.n, center.n) < 0.9f
+		   || std::abs(q.depth - center.depth) > 0.1f * center.depth)
+			continue;
+		r.Merge(q.reservoir, TargetPdf(center.p, center.n, center.albedo, q.reservoir.sample), u);
+	}
+	r.Finalize(TargetPdf(center.p, center.n, center.albedo, r.sample));
+
+	if(r.W <= 0 || Occluded(center.p + 1e-4f * center.n, r.sample.position, scene))
+		return vec3(0, 0, 0);
+	return UnshadowedLight(center.p, center.n, center.albedo, r.sample) * r.W;
+}
+
+/*
+    Relative error of every pixel: tiles with a pixel above
+    adaptiveThreshold are put into active (in the order of
+    tiles). Returns the mean relative error of all pixels.
+*/
+float ConvergenceMap(const vector<Tile>& tiles, vector<Tile>& active)
+{
+	double errorSum = 0;
+	size_t pixels = 0;
+	for(const Tile& tile : tiles){
+		pixels += size_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+		float maxError = 0;
+		for( int y=tile.y0; y<tile.y1; ++y ){
+			for( int x=tile.x0; x<tile.x1; ++x ){
+				float error = film.RelativeError(x, y);
+				errorSum += error;
+				maxError = max(maxError, error);
+			}
+		}
+		if(maxError > adaptiveThreshold)
+			active.push_back(tile);
+	}
+	return errorSum / pixels;
+}
+
+/*
+    Adds one sample to every pixel of the tile. The samples
+    are filtered into a FilmTile of the thread's own, which 
+    is merged into the film at the end; only the statistics
+    of the tile's pixels are written to the film directly.
+*/
+void RenderTile(const Camera* c, const Tile& tile)
+{
+	Sampler* tileSampler = samplerPrototype->Clone();
+	Sampler* reuseSampler = restir ? restirSampler->Clone() : nullptr;
+	Sampler* splits = splitSampler ? splitSampler->Clone() : nullptr;
+	FilmTile filmTile(film, tile.x0, tile.y0, tile.x1, tile.y1);
+	int segments = 0;
+	int paths = 0;
+	int samples = 0;
+
+	for( int y=tile.y0; y<tile.y1; ++y ){
+		for( int x=tile.x0; x<tile.x1; ++x ){
+
+			// pixels that are ahead wait for the pass that matches their samples
+			if(film.SampleCount(x, y) > currentPass)
+				continue;
+			++samples;
+
+			// pixels of tiles that were skipped have fewer samples
+			tileSampler->StartPixelSample(x, y, film.SampleCount(x, y));
+
+			CameraSample sample;
+			sample.pFilm = vec2(x, y) + tileSampler->Get2D();
+			sample.time = 0;
+			sample.pLens = tileSampler->Get2D();
+
+			Ray r;
+
+			c->GenerateRay(sample, r);
+
+			// cout << "vec4(" << r.d.x << "," << r.d.y << "," << r.d.z << "," << r.d.w << ")" << endl;
+			vec3 L;
+			int n = splits ? SplitCount(x, y) : 1;
+			if(integrator == Integrator::BDPT)
+				L = TraceBidirectional(c, r, *tileSampler, tileSplats[tile.index], segments);
+			else if(n > 1)
+				L = TraceSplit(r, x, y, n, *tileSampler, *splits, segments);
+			else
+				L = TracePath(r, *tileSampler, film.MeanLuminance(x, y), segments);
+			paths += n;
+			if(restir)
+				L += ReSTIRDirect(x, y, *reuseSampler);
+			filmTile.AddSample(x, y, sample.pFilm, L);
+		}
+	}
+
+	{
+		lock_guard<mutex> lock(filmMutex);
+		film.MergeTile(filmTile);
+	}
+
+	delete splits;
+	delete reuseSampler;
+	delete tileSampler;
+
+	pathCount += paths;
+	pathSegments += segments;
+	passSamples += samples;
+}
+
+/*
+    Primary-ray splitting: the mean of n paths that share 
+    the camera ray r and its first hit. The first takes the
+    rest of the pixel sample in sampler, the others sample 
+    i of pixel (x, y) of splits.
+*/
+vec3 TraceSplit(const Ray& r, int x, int y, int n, Sampler& sampler, Sampler& splits, int& segments)
+{
+	Intersection first;
+	++segments;
+	if(!ClosestIntersection(vec3(r.o.x, r.o.y, r.o.z), vec3(r.d.x, r.d.y, r.d.z), scene, first))
+		first.triangleIndex = -1;
+
+	float pixelEstimate = film.MeanLuminance(x, y);
+	vec3 L = TracePath(r, sampler, pixelEstimate, segments, &first);
+
+	// nothing to split if the ray left the scene
+	if(first.triangleIndex < 0)
+		return L;
+
+	int sampleIndex = film.SampleCount(x, y);
+	for(int k = 1; k < n; ++k){
+		splits.StartPixelSample(x, y, sampleIndex * MAX_SPLIT + k);
+		L += TracePath(r, splits, pixelEstimate, segments, &first);
+	}
+	return L / float(n);
+}
+
+/*
+    Paths to trace from the first hit of a sample of pixel
+    (x, y) in the current pass.
+*/
+int SplitCount(int x, int y)
+{
+	return splitMap[size_t(y) * screenWidth + x];
+}
+
+/*
+    Works out the paths per sample of every pixel of the crop
+    window for the next pass: splitCount, or with adaptiveSplit
+    fewer where the mean relative error of the 3 x 3 pixels
+    around it is below twice that of the image. Only called
+    between passes, when nothing is writing to the film.
+*/
+void UpdateSplitMap()
+{
+	double errorSum = 0;
+	for( int y=crop.y0; y<crop.y1; ++y )
+		for( int x=crop.x0; x<crop.x1; ++x )
+			errorSum += film.RelativeError(x, y);
+	meanRelativeError = errorSum / (double(crop.Width()) * crop.Height());
+	bool adapt = adaptiveSplit && meanRelativeError > 0 && std::isfinite(meanRelativeError);
+
+	for( int y=crop.y0; y<crop.y1; ++y ){
+		for( int x=crop.x0; x<crop.x1; ++x ){
+			uint8_t& splits = splitMap[size_t(y) * screenWidth + x];
+			splits = uint8_t(splitCount);
+			if(!adapt || film.SampleCount(x, y) < SPLIT_MIN_SAMPLES)
+				continue;
+
+			float error = 0;
+			int pixels = 0;
+			for( int ny=max(crop.y0, y-1); ny<=min(crop.y1-1, y+1); ++ny ){
+				for( int nx=max(crop.x0, x-1); nx<=min(crop.x1-1, x+1); ++nx ){
+					error += film.RelativeError(nx, ny);
+					++pixels;
+				}
+			}
+			error /= pixels;
+
+			float n = std::ceil(splitCount * error / (2 * meanRelativeError));
+			if(n < splitCount)
+				splits = uint8_t(max(1, int(n)));
 		}
 	}
 }
@@ -203,72 +1361,977 @@ void Draw()
 bool ClosestIntersection(
 	vec3 start, 
 	vec3 dir,
-	const vector<Triangle>& triangles, 
+	const Scene& scene, 
 	Intersection& closestIntersection 
 ){
-	closestIntersection.distance = std::numeric_limits<float>::max();
-	dir = glm::normalize(dir); // does not matter what you do here, the t aka x.x will adjust the length. No need to normalize
-
-	for(int i = 0; i < triangles.size(); ++i){
-		const Triangle & triangle = triangles[i];
-		using glm::vec3;
-		using glm::mat3;
-		vec3 v0 = triangle.v0;
-		vec3 v1 = triangle.v1; 
-		vec3 v2 = triangle.v2;
-		vec3 e1 = v1 - v0;
-		vec3 e2 = v2 - v0;
-		vec3 b = start - v0;
-		mat3 A( -dir, e1, e2 );
-		vec3 x = glm::inverse( A ) * b;
-
-		if(x.x > 0 && x.y >= 0 && x.z >= 0 && x.y <= 1 && x.z <= 1 && x.y + x.z <= 1){
-
-			vec3 end = start + x.x * dir;
-			float distance = glm::length(x.x * dir);
-			if(distance < closestIntersection.distance){
-				closestIntersection = {end, distance, i}; // element-wise copy assignment
+	return scene.Intersect(start, dir, closestIntersection.triangleIndex, 
+	                       closestIntersection.position, closestIntersection.distance);
+}
+
+/*
+    Returns true if any triangle blocks the segment between
+    start and end (both excluded).
+*/
+bool Occluded(vec3 start, vec3 end, const Scene& scene){
+	return scene.Occluded(start, end);
+}
+
+/*
+    Returns true if any triangle blocks the ray from start
+    along dir, so that it does not reach the environment.
+*/
+bool OccludedRay(vec3 start, vec3 dir, const Scene& scene){
+	return scene.OccludedRay(start, dir);
+}
+
+/*
+    Weight of a sample with density pdf when another strategy
+    would have produced it with density otherPdf.
+*/
+float MISWeight(float pdf, float otherPdf)
+{
+	switch (mis) {
+	case MIS::Balance:
+		return balanceHeuristic(1, pdf, 1, otherPdf);
+	case MIS::Power:
+		return powerHeuristic(1, pdf, 1, otherPdf);
+	default:
+		return 1;
+	}
+}
+
+/*
+    Density (per solid angle) of the bounce at a vertex with
+    the given (facing) normal choosing w. With guiding, 
+    bounces sample the BRDF or the distribution learned for
+    the leaf, once it has learned anything.
+*/
+float BouncePdf(int leaf, const vec3& normal, const vec3& w)
+{
+	float cosTheta = glm::dot(w, normal);
+	float bsdfPdf = cosTheta > 0 ? cosineHemisphereSamplePDF(cosTheta) : 0;
+	if (leaf < 0 || guide->Sampling(leaf).Empty())
+		return bsdfPdf;
+	return GUIDE_BSDF_FRACTION * bsdfPdf + (1 - GUIDE_BSDF_FRACTION) * guide->Sampling(leaf).Pdf(w);
+}
+
+/*
+    Adds what the path gained to the radiance that each of
+    the first n recorded vertices found (relative to the 
+    throughput of the path at the vertex).
+*/
+template <typename Record>
+void RecordContribution(Record* records, int n, const vec3& contribution)
+{
+	for (int k = 0; k < n; ++k) {
+		const vec3& b = records[k].beta;
+		records[k].L += vec3(b.r > 0 ? contribution.r / b.r : 0,
+		                     b.g > 0 ? contribution.g / b.g : 0,
+		                     b.b > 0 ? contribution.b / b.b : 0);
+	}
+}
+
+void SceneBounds(vec3& pMin, vec3& pMax)
+{
+	scene.Bounds(pMin, pMax);
+}
+
+/*
+    Writes the crop window of an image of the whole frame.
+*/
+void SaveImage(const bitmap_image& frame, const string& path)
+{
+	const int width = int(frame.width());
+	const int height = int(frame.height());
+	if(crop.Width() == width && crop.Height() == height){
+		frame.save_image(path);
+		return;
+	}
+	bitmap_image window;
+	frame.region(crop.x0, crop.y0, crop.Width(), crop.Height(), window);
+	window.save_image(path);
+}
+
+/*
+    Scales a loaded mesh to fit a box half the size of the
+    room, centred on the floor. Models are y-up, so it is
+    turned half a revolution about x, which also turns their
+    front (+z) towards the camera.
+*/
+void PlaceModel(Mesh& mesh)
+{
+	for (vec3& p : mesh.positions)
+		p = vec3(p.x, -p.y, -p.z);
+
+	vec3 pMin, pMax;
+	mesh.Bounds(pMin, pMax);
+	vec3 extent = pMax - pMin;
+	float scale = MODEL_SIZE / std::max(extent.x, std::max(extent.y, extent.z));
+	vec3 base(0.5f * (pMin.x + pMax.x), pMax.y, 0.5f * (pMin.z + pMax.z));
+	for (vec3& p : mesh.positions)
+		p = vec3(0, 1, 0) + scale * (p - base);
+}
+
+/*
+    Probability for a path with throughput beta to continue.
+*/
+float SurvivalProbability(const vec3& beta, float pixelEstimate)
+{
+	float maxBeta = std::max(beta.r, std::max(beta.g, beta.b));
+
+	if (roulette == Roulette::Efficiency && pixelEstimate > 0 && imageMean > 0) {
+		// never below 5%, which would make the survivors fireflies
+		float expected = luminance(beta) * imageMean;
+		return std::min(1.f, std::max(0.05f, expected / pixelEstimate));
+	}
+
+	return std::min(1.f, maxBeta);
+}
+
+/*
+    What a vertex at the given depth adds to a path, clamped
+    to maxContribution from the second vertex on.
+*/
+vec3 ClampContribution(const vec3& contribution, int depth)
+{
+	if (maxContribution <= 0 || depth == 0)
+		return contribution;
+
+	float l = luminance(contribution);
+	return l > maxContribution ? contribution * (maxContribution / l) : contribution;
+}
+
+/*
+    Estimates the radiance arriving along r. Light from 
+    emitters is found both by sampling the lights at every
+    vertex and by the bounces happening to hit them; with
+    MIS both estimates are weighted by how likely each 
+    strategy is to produce them, otherwise only light 
+    sampling counts.
+
+    pixelEstimate is the current estimate (luminance) of the
+    pixel the path belongs to, 0 if there is none yet. The 
+    number of rays traced is added to segments. If firstHit
+    is given, it is what r hits (a triangleIndex of -1 for 
+    nothing), and r is not traced again.
+*/
+vec3 TracePath(Ray r, Sampler& sampler, float pixelEstimate, int& segments, const Intersection* firstHit) {
+	vec3 L(0,0,0);
+	vec3 beta(1,1,1); // throughput of the path so far
+
+	// previous vertex, for the MIS weight of emitters hit by the bounce
+	vec3 prevPosition;
+	vec3 prevNormal;
+	float prevPdf = 0;
+
+	// vertices that learn from this path, for guiding
+	GuideRecord records[GUIDE_MAX_VERTICES];
+	int numRecords = 0;
+	bool recording = guide && guideTraining;
+
+	// vertices whose radiance goes into the cache
+	CacheRecord cacheRecords[CACHE_MAX_VERTICES];
+	int numCacheRecords = 0;
+
+	auto add = [&](const vec3& contribution) {
+		L += contribution;
+		if (recording)
+			RecordContribution(records, numRecords, contribution);
+		RecordContribution(cacheRecords, numCacheRecords, contribution);
+	};
+
+	for (int depth = 0; depth < maxDepth; ++depth) {
+		vec3 dir(r.d.x,r.d.y,r.d.z);
+		bool traced = depth == 0 && firstHit;
+		if (!traced)
+			++segments;
+
+		sampler.SetDimension(CAMERA_DIMENSIONS + depth * BOUNCE_DIMENSIONS);
+		float uLight = sampler.Get1D();
+		vec2 uLightPoint = sampler.Get2D();
+		vec2 uBounce = sampler.Get2D();
+		float uRoulette = sampler.Get1D();
+		vec2 uEnvironment = sampler.Get2D();
+
+		Intersection i;
+		if (traced)
+			i = *firstHit;
+		if (traced ? i.triangleIndex < 0 : !ClosestIntersection(vec3(r.o.x,r.o.y,r.o.z),dir,scene,i)) {
+			// Nothing was hit; the environment is all around, e.g while outside
+			vec3 w = glm::normalize(dir);
+			float weight = 1;
+			if (depth > 0 && sampleEnvironment)
+				weight = mis == MIS::None ? 0 : MISWeight(prevPdf, environment->Pdf(w));
+			add(ClampContribution(beta * environment->Le(w) * weight, depth));
+			break;
+		}
+
+		// the only shading data this path reads at this vertex
+		const Material& material = scene.GetMaterial(i.triangleIndex);
+		const vec3& surfaceNormal = scene.Normal(i.triangleIndex);
+
+		// Shade the side of the triangle that the ray arrived from.
+		vec3 normal = surfaceNormal;
+		bool frontFace = glm::dot(normal, dir) < 0;
+		if (!frontFace)
+			normal = -normal;
+
+		// Emitters only emit on their front side.
+		if (frontFace && material.IsEmissive()) {
+			float weight = 1;
+			if (depth > 0 && lightSampler) {
+				// with ReSTIR, the reservoirs account for all of it
+				if (mis == MIS::None || (restir && depth == 1)) {
+					weight = 0;
+				} else {
+					vec3 toLight = i.position - prevPosition;
+					float dist2 = glm::dot(toLight, toLight);
+					float cosLight = -glm::dot(glm::normalize(dir), surfaceNormal);
+					float lightPdf = lightSampler->Pdf(prevPosition, prevNormal, i.triangleIndex) * dist2 / cosLight;
+					weight = MISWeight(prevPdf, lightPdf);
+				}
+			}
+			add(ClampContribution(beta * material.emittance * weight, depth));
+		}
+
+		// With a photon map the first bounce ends here, with all the 
+		// light the photons brought to this point.
+		if (photonMap && depth == 1) {
+			vec3 E = photonMap->Irradiance(i.position, normal, photonGather, PHOTON_RADIUS * sceneRadius);
+			add(ClampContribution(beta * material.color / float(PI) * E, depth));
+			break;
+		}
+
+		// With a radiance cache the path ends at cacheDepth, on what
+		// earlier paths found leaving this cell.
+		if (radianceCache && depth == cacheDepth) {
+			vec3 cached;
+			if (radianceCache->Lookup(i.position, normal, CACHE_MIN_SAMPLES, cached)) {
+				add(ClampContribution(beta * cached, depth));
+				break;
 			}
 		}
+		if (radianceCache && numCacheRecords < CACHE_MAX_VERTICES && !(restir && depth == 0))
+			cacheRecords[numCacheRecords++] = {i.position, normal, beta, vec3(0, 0, 0)};
+
+		int leaf = guide ? guide->Leaf(i.position) : -1;
+
+		// The origin of new rays is offset slightly to avoid hitting the 
+		// same triangle again.
+		vec3 origin = i.position + 1e-4f * normal;
+		vec3 BRDF = material.color / float(PI); // color == reflectance
+
+		// Sample a point on a light and add its contribution if it is
+		// visible (and would not be past the last bounce).
+		if (lightSampler && depth + 1 < maxDepth && !(restir && depth == 0)) {
+			LightSample ls;
+			if (lightSampler->Sample(i.position, normal, uLight, uLightPoint, ls)) {
+				vec3 toLight = ls.position - i.position;
+				float dist2 = glm::dot(toLight, toLight);
+				vec3 wi = toLight / std::sqrt(dist2);
+				float cosSurface = glm::dot(wi, normal);
+				float cosLight = -glm::dot(wi, ls.normal);
+
+				if (cosSurface > 0 && cosLight > 0 && !Occluded(origin, ls.position, scene)) {
+					// light pdf with respect to solid angle
+					float lightPdf = ls.pdf * dist2 / cosLight;
+					float weight = mis != MIS::None ? MISWeight(lightPdf, BouncePdf(leaf, normal, wi)) : 1;
+
+					// the light sample is a sample of the radiance arriving here 
+					// too, weighted like the emitters that bounces find
+					if (recording)
+						guide->Building(leaf).Record(wi, luminance(ls.emittance) * weight / lightPdf);
+
+					// regularization: the MIS weight keeps the true pdf
+					if (depth > 0 && dist2 < regularizeDistance * regularizeDistance)
+						lightPdf = ls.pdf * regularizeDistance * regularizeDistance / cosLight;
+
+					add(ClampContribution(beta * BRDF * ls.emittance * cosSurface * weight / lightPdf, depth));
+				}
+			}
+		}
+
+		// The same for a direction of the environment, which is
+		// visible if the ray towards it leaves the scene.
+		if (sampleEnvironment && depth + 1 < maxDepth) {
+			vec3 wi;
+			float envPdf;
+			vec3 Le = environment->Sample(uEnvironment, wi, envPdf);
+			float cosSurface = glm::dot(wi, normal);
+			if (envPdf > 0 && cosSurface > 0 && luminance(Le) > 0 && !OccludedRay(origin, wi, scene)) {
+				float weight = mis != MIS::None ? MISWeight(envPdf, BouncePdf(leaf, normal, wi)) : 1;
+				if (recording)
+					guide->Building(leaf).Record(wi, luminance(Le) * weight / envPdf);
+				add(ClampContribution(beta * BRDF * Le * cosSurface * weight / envPdf, depth));
+			}
+		}
+
+		// Pick a random direction from here and keep going.
+		vec3 newDir;
+		if (leaf >= 0 && !guide->Sampling(leaf).Empty()) {
+			// one sample of the mixture of the BRDF and the learned
+			// distribution, which may point below the surface
+			if (uBounce.x < GUIDE_BSDF_FRACTION) {
+				uBounce.x /= GUIDE_BSDF_FRACTION;
+				newDir = cosineHemisphereSample(normal, uBounce);
+			} else {
+				uBounce.x = (uBounce.x - GUIDE_BSDF_FRACTION) / (1 - GUIDE_BSDF_FRACTION);
+				float guidePdf;
+				newDir = guide->Sampling(leaf).Sample(uBounce, guidePdf);
+			}
+			float cosTheta = glm::dot(newDir, normal);
+			prevPdf = BouncePdf(leaf, normal, newDir);
+			if (cosTheta <= 0 || prevPdf <= 0)
+				break;
+			beta *= material.color * (cosTheta / float(PI)) / prevPdf;
+		} else {
+			newDir = cosineHemisphereSample(normal, uBounce);
+
+			// Apply the Rendering Equation here. With a Lambertian BRDF
+			// (color / PI) and a cosine-weighted direction (pdf cos / PI)
+			// BRDF * cos / pdf reduces to the reflectance.
+			beta *= material.color;
+			prevPdf = cosineHemisphereSamplePDF(glm::dot(newDir, normal));
+		}
+
+		prevPosition = i.position;
+		prevNormal = normal;
+
+		if (roulette != Roulette::None && depth + 1 >= rrDepth) {
+			float q = SurvivalProbability(beta, pixelEstimate);
+			if (uRoulette >= q)
+				break;
+			beta /= q;
+		}
+
+		if (recording && numRecords < GUIDE_MAX_VERTICES)
+			records[numRecords++] = {leaf, newDir, prevPdf, beta, vec3(0, 0, 0)};
+
+		r.o = vec4(origin, 1);
+		r.d = vec4(newDir, 0);
 	}
 
-	if(closestIntersection.distance == std::numeric_limits<float>::max()){
-		return false;
+	for (int k = 0; k < numRecords; ++k)
+		guide->Building(records[k].leaf).Record(records[k].wi, luminance(records[k].L) / records[k].pdf);
+	for (int k = 0; k < numCacheRecords; ++k)
+		radianceCache->Add(cacheRecords[k].p, cacheRecords[k].n, cacheRecords[k].L);
+
+	return L;
+}
+
+// ----------------------------------------------------------------------------
+// BIDIRECTIONAL PATH TRACING
+//
+// Follows Veach's formulation as laid out in pbrt: every vertex stores
+// the density of being sampled by its own subpath (pdfFwd) and by the
+// other one (pdfRev), both per unit area (per solid angle for the sky),
+// and the MIS weight of a connection follows from their ratios.
+
+struct PathVertex {
+	enum class Type { Camera, Light, Surface, Sky };
+	Type type;
+	vec3 p;
+	vec3 n;    // geometric normal; for the sky, the direction towards it
+	vec3 wo;   // towards the previous vertex of the subpath (surfaces)
+	vec3 beta; // throughput of the subpath up to here
+	int triangleIndex;
+	float pdfFwd, pdfRev;
+};
+
+typedef PathVertex::Type VertexType;
+
+/*
+    Bounding sphere of the scene, for light paths starting on
+    the sky, and the distribution that light paths start from.
+*/
+void InitLightPaths()
+{
+	vec3 pMin, pMax;
+	SceneBounds(pMin, pMax);
+	sceneCenter = 0.5f * (pMin + pMax);
+	sceneRadius = 0.5f * glm::length(pMax - pMin);
+
+	vector<float> power;
+	emitterIndex.assign(scene.Size(), -1);
+	for(size_t i = 0; i < triangles.size(); ++i){
+		if(triangles[i].IsEmissive()){
+			emitterIndex[i] = emitters.size();
+			emitters.push_back(i);
+			power.push_back(LightPower(triangles[i]));
+		}
+	}
+	power.push_back(float(PI) * sceneRadius * sceneRadius * environment->MeanLuminance());
+	emitterTable = AliasTable(power);
+}
+
+bool IsOnSurface(const PathVertex& v)
+{
+	return v.type == VertexType::Surface || v.type == VertexType::Light;
+}
+
+/*
+    Radiance emitted from v towards the vertex prev.
+*/
+vec3 Emitted(const PathVertex& v, const PathVertex& prev)
+{
+	if(v.type == VertexType::Sky)
+		return environment->Le(v.n);
+	if(v.type == VertexType::Camera)
+		return vec3(0, 0, 0);
+
+	const Material& material = scene.GetMaterial(v.triangleIndex);
+	if(!material.IsEmissive() || glm::dot(scene.Normal(v.triangleIndex), prev.p - v.p) <= 0)
+		return vec3(0, 0, 0);
+	return material.emittance;
+}
+
+vec3 DirectionTo(const PathVertex& from, const PathVertex& to)
+{
+	if(to.type == VertexType::Sky)
+		return to.n;
+	return glm::normalize(to.p - from.p);
+}
+
+/*
+    BRDF at the surface vertex v for light between next and
+    the vertex the subpath came from: Lambertian, and only 
+    for reflection.
+*/
+vec3 BRDF(const PathVertex& v, const PathVertex& next)
+{
+	vec3 wi = DirectionTo(v, next);
+	if(glm::dot(wi, v.n) * glm::dot(v.wo, v.n) <= 0)
+		return vec3(0, 0, 0);
+	return scene.GetMaterial(v.triangleIndex).color / float(PI);
+}
+
+/*
+    Converts the density pdf of the direction from 'from' to
+    'to' (per solid angle) into a density per area at 'to'.
+*/
+float ConvertDensity(float pdf, const PathVertex& from, const PathVertex& to)
+{
+	if(to.type == VertexType::Sky)
+		return pdf;
+
+	vec3 w = to.p - from.p;
+	float dist2 = glm::dot(w, w);
+	if(dist2 == 0)
+		return 0;
+	if(IsOnSurface(to))
+		pdf *= std::abs(glm::dot(to.n, w)) / std::sqrt(dist2);
+	return pdf / dist2;
+}
+
+/*
+    Density (per area at next) of the light vertex v emitting
+    towards next.
+*/
+float PdfLight(const PathVertex& v, const PathVertex& next)
+{
+	if(v.type == VertexType::Sky){
+		// uniformly over a disk covering the scene
+		float pdf = 1 / (float(PI) * sceneRadius * sceneRadius);
+		if(IsOnSurface(next))
+			pdf *= std::abs(glm::dot(next.n, v.n));
+		return pdf;
+	}
+
+	vec3 w = next.p - v.p;
+	float dist2 = glm::dot(w, w);
+	w /= std::sqrt(dist2);
+	float pdf = cosineHemisphereSamplePDF(glm::dot(scene.Normal(v.triangleIndex), w)) / dist2;
+	if(IsOnSurface(next))
+		pdf *= std::abs(glm::dot(next.n, w));
+	return pdf;
+}
+
+/*
+    Density of a light path starting at the light vertex v: 
+    per area for emitters, per solid angle for the sky.
+*/
+float PdfLightOrigin(const PathVertex& v)
+{
+	if(v.type == VertexType::Sky)
+		return emitterTable.Pmf(emitters.size()) * environment->Pdf(v.n);
+
+	int light = emitterIndex[v.triangleIndex];
+	if(light < 0)
+		return 0;
+	return emitterTable.Pmf(light) / triangles[v.triangleIndex].Area();
+}
+
+/*
+    Density (per area at next) of v sampling next, when v was
+    reached from prev.
+*/
+float PdfVertex(const Camera* c, const PathVertex& v, const PathVertex* prev, const PathVertex& next)
+{
+	if(v.type == VertexType::Light || v.type == VertexType::Sky)
+		return PdfLight(v, next);
+
+	vec3 wn = DirectionTo(v, next);
+	float pdf;
+	if(v.type == VertexType::Camera){
+		Ray ray;
+		ray.o = vec4(v.p, 1);
+		ray.d = vec4(wn, 0);
+		float pdfPos;
+		c->PdfWe(ray, pdfPos, pdf);
 	} else {
-		return true;
+		vec3 wp = glm::normalize(prev->p - v.p);
+		vec3 facing = glm::dot(v.n, wp) > 0 ? v.n : -v.n;
+		float cosTheta = glm::dot(wn, facing);
+		pdf = cosTheta > 0 ? cosineHemisphereSamplePDF(cosTheta) : 0;
 	}
+	return ConvertDensity(pdf, v, next);
+}
+
+bool Unoccluded(const PathVertex& a, const PathVertex& b)
+{
+	vec3 d = b.p - a.p;
+	vec3 pa = a.p;
+	vec3 pb = b.p;
+	if(IsOnSurface(a))
+		pa += 1e-4f * (glm::dot(a.n, d) > 0 ? a.n : -a.n);
+	if(IsOnSurface(b))
+		pb += 1e-4f * (glm::dot(b.n, d) < 0 ? b.n : -b.n);
+	return !Occluded(pa, pb, scene);
+}
+
+// geometry term between two finite vertices, including visibility
+float G(const PathVertex& a, const PathVertex& b)
+{
+	vec3 d = a.p - b.p;
+	float g = 1 / glm::dot(d, d);
+	d = glm::normalize(d);
+	if(IsOnSurface(a))
+		g *= std::abs(glm::dot(a.n, d));
+	if(IsOnSurface(b))
+		g *= std::abs(glm::dot(b.n, d));
+	return Unoccluded(a, b) ? g : 0;
 }
 
-vec3 TracePath(Ray &r, int depth) {
-	if (depth >= maxDepth) {
-		return vec3(0,0,0);  // Bounced enough times.
+/*
+    Extends a subpath from path[-1] along r, storing up to 
+    maxVertices new vertices in path. pdf is the density (per
+    solid angle) that r was sampled with. Camera subpaths that
+    leave the scene end on a sky vertex. Returns the number 
+    of vertices added.
+*/
+int RandomWalk(Ray r, vec3 beta, float pdf, int maxVertices, bool fromCamera,
+               Sampler& sampler, PathVertex* path, int& segments)
+{
+	float betaStart = std::max(beta.r, std::max(beta.g, beta.b));
+	float pdfFwd = pdf;
+	int bounces = 0;
+
+	while(bounces < maxVertices){
+		PathVertex& prev = path[bounces - 1];
+		PathVertex& v = path[bounces];
+		vec3 dir = glm::normalize(vec3(r.d.x, r.d.y, r.d.z));
+		++segments;
+
+		vec2 uBounce = sampler.Get2D();
+		float uRoulette = sampler.Get1D();
+
+		Intersection i;
+		if(!ClosestIntersection(vec3(r.o.x, r.o.y, r.o.z), dir, scene, i)){
+			if(fromCamera){
+				v.type = VertexType::Sky;
+				v.n = dir;
+				v.beta = beta;
+				v.pdfFwd = pdfFwd;
+				v.pdfRev = 0;
+				++bounces;
+			}
+			break;
+		}
+
+		v.type = VertexType::Surface;
+		v.p = i.position;
+		v.n = scene.Normal(i.triangleIndex);
+		v.wo = -dir;
+		v.beta = beta;
+		v.triangleIndex = i.triangleIndex;
+		v.pdfFwd = ConvertDensity(pdfFwd, prev, v);
+		v.pdfRev = 0;
+		if(++bounces >= maxVertices)
+			break;
+
+		// cosine-weighted bounce on the side the path arrived from; 
+		// Lambertian, so BRDF * cos / pdf is the reflectance
+		vec3 facing = glm::dot(v.n, v.wo) > 0 ? v.n : -v.n;
+		vec3 wi = cosineHemisphereSample(facing, uBounce);
+		pdfFwd = cosineHemisphereSamplePDF(glm::dot(wi, facing));
+		if(pdfFwd <= 0)
+			break;
+		beta *= scene.GetMaterial(i.triangleIndex).color;
+		prev.pdfRev = ConvertDensity(cosineHemisphereSamplePDF(glm::dot(v.wo, facing)), v, prev);
+
+		if(roulette != Roulette::None && bounces >= rrDepth){
+			float q = std::min(1.f, std::max(beta.r, std::max(beta.g, beta.b)) / betaStart);
+			if(uRoulette >= q)
+				break;
+			beta /= q;
+		}
+
+		r.o = vec4(v.p + 1e-4f * facing, 1);
+		r.d = vec4(wi, 0);
 	}
 
-	Intersection i;
-	if (!ClosestIntersection(vec3(r.o.x,r.o.y,r.o.z),vec3(r.d.x,r.d.y,r.d.z),triangles,i)) {
-		return 0.7f*vec3(1,1,1);  // Nothing was hit; everything around you emits white light, e.g while outside
+	return bounces;
+}
+
+int CameraSubpath(const Camera* c, const Ray& r, Sampler& sampler, int maxVertices, PathVertex* path, int& segments)
+{
+	if(maxVertices == 0)
+		return 0;
+
+	float pdfPos, pdfDir;
+	c->PdfWe(r, pdfPos, pdfDir);
+
+	PathVertex& v = path[0];
+	v.type = VertexType::Camera;
+	v.p = vec3(r.o.x, r.o.y, r.o.z);
+	v.beta = vec3(1, 1, 1);
+	v.pdfFwd = v.pdfRev = 0;
+
+	return RandomWalk(r, v.beta, pdfDir, maxVertices - 1, true, sampler, path + 1, segments) + 1;
+}
+
+int LightSubpath(Sampler& sampler, int maxVertices, PathVertex* path, int& segments)
+{
+	float uEmitter = sampler.Get1D();
+	vec2 uPosition = sampler.Get2D();
+	vec2 uDirection = sampler.Get2D();
+	if(maxVertices == 0)
+		return 0;
+
+	float pmf;
+	int emitter = emitterTable.Sample(uEmitter, pmf);
+	PathVertex& v = path[0];
+	Ray r = Ray();
+
+	if(emitter == int(emitters.size())){
+		// the sky: a direction sampled from the environment, entering
+		// the scene through a disk that covers it
+		vec3 w;
+		float pdfDir;
+		vec3 Le = environment->Sample(uDirection, w, pdfDir);
+		if(pdfDir <= 0)
+			return 0;
+		vec3 d = -w;
+		vec3 t, b;
+		coordinateSystem(d, t, b);
+		vec2 pDisk = concentricSampleDisk(uPosition);
+		vec3 origin = sceneCenter + sceneRadius * (pDisk.x * t + pDisk.y * b - d);
+		float pdfPos = 1 / (float(PI) * sceneRadius * sceneRadius);
+
+		v.type = VertexType::Sky;
+		v.p = origin;
+		v.n = w;
+		v.beta = Le;
+		v.pdfRev = 0;
+
+		r.o = vec4(origin, 1);
+		r.d = vec4(d, 0);
+		int n = RandomWalk(r, Le / (pmf * pdfPos * pdfDir), pdfDir, maxVertices - 1, false, sampler, path + 1, segments);
+
+		// the sky is sampled by direction, the first hit by position on the disk
+		if(n > 0)
+			path[1].pdfFwd = pdfPos * std::abs(glm::dot(d, path[1].n));
+		v.pdfFwd = pmf * pdfDir;
+		return n + 1;
 	}
 
-	Triangle& triangle = triangles[i.triangleIndex];
-	vec3 emittance = triangle.emittance;
+	const Triangle& triangle = triangles[emitters[emitter]];
+	vec3 d = cosineHemisphereSample(triangle.normal, uDirection);
+	float pdfPos = 1 / triangle.Area();
+	float pdfDir = cosineHemisphereSamplePDF(glm::dot(d, triangle.normal));
 
-	// Pick a random direction from here and keep going.
-	Ray newRay;
-	newRay.o = vec4(i.position,1);
+	v.type = VertexType::Light;
+	v.p = triangle.SamplePoint(uPosition);
+	v.n = triangle.normal;
+	v.beta = triangle.emittance;
+	v.triangleIndex = emitters[emitter];
+	v.pdfFwd = pmf * pdfPos;
+	v.pdfRev = 0;
+	if(pdfDir <= 0)
+		return 1;
 
-	// This is NOT a cosine-weighted distribution!
-	newRay.d = vec4(uniformHemisphereSample(triangle.normal, 1), 0);
+	r.o = vec4(v.p + 1e-4f * triangle.normal, 1);
+	r.d = vec4(d, 0);
+	vec3 beta = triangle.emittance * glm::dot(d, triangle.normal) / (pmf * pdfPos * pdfDir);
+	return RandomWalk(r, beta, pdfDir, maxVertices - 1, false, sampler, path + 1, segments) + 1;
+}
 
-	// Probability of the newRay
-	const float p = uniformHemisphereSamplePDF(1);
+float Remap0(float f)
+{
+	return f != 0 ? f : 1;
+}
 
-	// Compute the BRDF for this ray (assuming Lambertian reflection)
-	float cos_theta = glm::dot(vec3(newRay.d.x,newRay.d.y,newRay.d.z), triangle.normal);
-	vec3 BRDF = triangle.color / float(PI) ; // color == reflectance
+/*
+    MIS weight of the path made by connecting the first s 
+    light vertices to the first t camera vertices, against 
+    every other (s', t') with s' + t' = s + t that could have 
+    made it. sampled replaces the endpoint that the 
+    connection sampled itself (s or t of 1). The pdfRev of 
+    the vertices at the connection are changed for the 
+    evaluation and restored afterwards.
+*/
+float BidirectionalMISWeight(const Camera* c, PathVertex* light, PathVertex* camera,
+                             const PathVertex& sampled, int s, int t)
+{
+	// the only strategy for paths of two vertices: (1, 1) is never
+	// used, and paths are never started on the lens (t = 0)
+	if(s + t == 2)
+		return 1;
+
+	PathVertex savedEndpoint = PathVertex();
+	if(s == 1){
+		savedEndpoint = light[0];
+		light[0] = sampled;
+	} else if(t == 1){
+		savedEndpoint = camera[0];
+		camera[0] = sampled;
+	}
+
+	PathVertex* qs = s > 0 ? &light[s - 1] : nullptr;
+	PathVertex* pt = &camera[t - 1];
+	PathVertex* qsMinus = s > 1 ? &light[s - 2] : nullptr;
+	PathVertex* ptMinus = t > 1 ? &camera[t - 2] : nullptr;
+
+	float saved[4] = {
+		pt->pdfRev,
+		ptMinus ? ptMinus->pdfRev : 0,
+		qs ? qs->pdfRev : 0,
+		qsMinus ? qsMinus->pdfRev : 0
+	};
+
+	pt->pdfRev = s > 0 ? PdfVertex(c, *qs, qsMinus, *pt) : PdfLightOrigin(*pt);
+	if(ptMinus)
+		ptMinus->pdfRev = s > 0 ? PdfVertex(c, *pt, qs, *ptMinus) : PdfLight(*pt, *ptMinus);
+	if(qs)
+		qs->pdfRev = PdfVertex(c, *pt, ptMinus, *qs);
+	if(qsMinus)
+		qsMinus->pdfRev = PdfVertex(c, *qs, pt, *qsMinus);
+
+	// ratios of the densities of the other strategies to this one
+	float exponent = mis == MIS::Power ? 2 : 1;
+	float sumRatios = 0;
+	float ratio = 1;
+	for(int i = t - 1; i > 0; --i){
+		ratio *= Remap0(camera[i].pdfRev) / Remap0(camera[i].pdfFwd);
+		sumRatios += std::pow(ratio, exponent);
+	}
+	ratio = 1;
+	for(int i = s - 1; i >= 0; --i){
+		ratio *= Remap0(light[i].pdfRev) / Remap0(light[i].pdfFwd);
+		sumRatios += std::pow(ratio, exponent);
+	}
+
+	pt->pdfRev = saved[0];
+	if(ptMinus)
+		ptMinus->pdfRev = saved[1];
+	if(qs)
+		qs->pdfRev = saved[2];
+	if(qsMinus)
+		qsMinus->pdfRev = saved[3];
+	if(s == 1)
+		light[0] = savedEndpoint;
+	else if(t == 1)
+		camera[0] = savedEndpoint;
+
+	return 1 / (1 + sumRatios);
+}
+
+/*
+    Contribution of the path made of the first s light and t
+    camera vertices, MIS weighted. For t = 1 the lens point 
+    is sampled here, and pRaster is set to the point of the 
+    film that the contribution belongs to.
+*/
+vec3 Connect(const Camera* c, PathVertex* light, PathVertex* camera, int s, int t,
+             Sampler& sampler, vec2& pRaster)
+{
+	PathVertex& pt = camera[t - 1];
+	if(t > 1 && s != 0 && pt.type == VertexType::Sky)
+		return vec3(0, 0, 0);
+
+	PathVertex sampled;
+	vec3 L(0, 0, 0);
+
+	if(s == 0){
+		// the camera subpath found an emitter by itself
+		L = pt.beta * Emitted(pt, camera[t - 2]);
+	} else if(t == 1){
+		// connect the light subpath to a point on the lens
+		const PathVertex& qs = light[s - 1];
+		vec3 wi, pLens;
+		float pdf;
+		float We = c->SampleWi(qs.p, sampler.Get2D(), wi, pLens, pdf, pRaster);
+		if(pdf > 0 && We > 0){
+			sampled.type = VertexType::Camera;
+			sampled.p = pLens;
+			sampled.beta = vec3(We / pdf);
+			sampled.pdfFwd = sampled.pdfRev = 0;
+			L = qs.beta * BRDF(qs, sampled) * sampled.beta * std::abs(glm::dot(wi, qs.n));
+			if(L != vec3(0, 0, 0) && !Unoccluded(qs, sampled))
+				L = vec3(0, 0, 0);
+		}
+	} else if(s == 1){
+		// sample a point on an emitter (or a direction of the sky) for pt
+		float uEmitter = sampler.Get1D();
+		vec2 uLight = sampler.Get2D();
+		if(pt.type != VertexType::Surface)
+			return vec3(0, 0, 0);
+
+		float pmf;
+		int emitter = emitterTable.Sample(uEmitter, pmf);
+		vec3 wi;
+		bool visible;
+		if(emitter == int(emitters.size())){
+			float pdf;
+			vec3 Le = environment->Sample(uLight, wi, pdf);
+			if(pdf <= 0)
+				return vec3(0, 0, 0);
+			sampled.type = VertexType::Sky;
+			sampled.n = wi;
+			sampled.beta = Le / (pdf * pmf);
+
+			vec3 facing = glm::dot(pt.n, wi) > 0 ? pt.n : -pt.n;
+			visible = !OccludedRay(pt.p + 1e-4f * facing, wi, scene);
+		} else {
+			const Triangle& triangle = triangles[emitters[emitter]];
+			sampled.type = VertexType::Light;
+			sampled.p = triangle.SamplePoint(uLight);
+			sampled.n = triangle.normal;
+			sampled.triangleIndex = emitters[emitter];
+
+			vec3 toLight = sampled.p - pt.p;
+			float dist2 = glm::dot(toLight, toLight);
+			wi = toLight / std::sqrt(dist2);
+			float cosLight = -glm::dot(wi, triangle.normal);
+			if(cosLight <= 0)
+				return vec3(0, 0, 0);
+			float pdf = dist2 / (cosLight * triangle.Area());
+			sampled.beta = triangle.emittance / (pdf * pmf);
+			visible = true;
+		}
+		sampled.pdfFwd = PdfLightOrigin(sampled);
+		sampled.pdfRev = 0;
+
+		L = pt.beta * BRDF(pt, sampled) * sampled.beta * std::abs(glm::dot(wi, pt.n));
+		if(L != vec3(0, 0, 0) && !(visible && (sampled.type == VertexType::Sky || Unoccluded(pt, sampled))))
+			L = vec3(0, 0, 0);
+	} else {
+		// connect two surface vertices
+		const PathVertex& qs = light[s - 1];
+		if(pt.type != VertexType::Surface || qs.type != VertexType::Surface)
+			return vec3(0, 0, 0);
+		L = qs.beta * BRDF(qs, pt) * BRDF(pt, qs) * pt.beta;
+		if(L != vec3(0, 0, 0))
+			L *= G(qs, pt);
+	}
 
-	// Recursively trace reflected light sources.
-	vec3 incoming = TracePath(newRay, depth + 1);
+	if(L == vec3(0, 0, 0))
+		return L;
+	return L * BidirectionalMISWeight(c, light, camera, sampled, s, t);
+}
+
+/*
+    Estimates the radiance arriving along the camera ray r
+    with bidirectional path tracing: traces a camera and a 
+    light subpath and sums the connections of every prefix 
+    of the one with every prefix of the other. Connections 
+    to the lens (t = 1) are added to splats instead. The 
+    number of rays traced is added to segments.
+*/
+vec3 TraceBidirectional(const Camera* c, const Ray& r, Sampler& sampler, vector<Splat>& splats, int& segments)
+{
+	arena.Reset();
+
+	// a path of maxDepth segments has maxDepth + 1 vertices
+	int depth = std::min(maxDepth, BDPT_MAX_DEPTH);
+	PathVertex* camera = arena.Alloc<PathVertex>(depth + 1);
+	PathVertex* light = arena.Alloc<PathVertex>(depth);
+
+	int nCamera = CameraSubpath(c, r, sampler, depth + 1, camera, segments);
+	int nLight = LightSubpath(sampler, depth, light, segments);
+
+	vec3 L(0, 0, 0);
+	for(int t = 1; t <= nCamera; ++t){
+		for(int s = 0; s <= nLight; ++s){
+			if(s + t < 2 || (s == 1 && t == 1) || s + t - 1 > maxDepth)
+				continue;
+
+			vec2 pRaster;
+			vec3 contribution = Connect(c, light, camera, s, t, sampler, pRaster);
+			if(t == 1){
+				if(contribution != vec3(0, 0, 0))
+					splats.push_back({int(pRaster.x), int(pRaster.y), contribution});
+			} else {
+				L += contribution;
+			}
+		}
+	}
+
+	return L;
+}
 
-	// Apply the Rendering Equation here.
-	return emittance + (BRDF * incoming * cos_theta / p);
-}
\ No newline at end of file
+// ----------------------------------------------------------------------------
+// PHOTON MAPPING
+
+/*
+    Traces numPhotons light paths, split evenly over the
+    threads, and builds photonMap from the photons they 
+    leave. A photon that lands k bounces from its light is 
+    seen by camera paths of k + 2 segments, so light paths 
+    are cut short accordingly.
+*/
+void EmitPhotons()
+{
+	auto start = chrono::steady_clock::now();
+	int maxVertices = std::min(maxDepth, BDPT_MAX_DEPTH) - 1;
+	Sampler* photonSampler = MakeSampler("sobol", numPhotons, seed);
+
+	vector<vector<Photon>> deposited(numThreads);
+	vector<thread> workers;
+	for(int w = 0; w < numThreads; ++w){
+		workers.push_back(thread([w, maxVertices, photonSampler, &deposited](){
+			Sampler* sampler = photonSampler->Clone();
+			int segments = 0;
+			int begin = int(int64_t(numPhotons) * w / numThreads);
+			int end = int(int64_t(numPhotons) * (w + 1) / numThreads);
+
+			for(int p = begin; p < end; ++p){
+				arena.Reset();
+				PathVertex* path = arena.Alloc<PathVertex>(std::max(1, maxVertices));
+
+				// every light path is one sample of the same (-1, -1) pixel
+				sampler->StartPixelSample(-1, -1, p);
+				int n = LightSubpath(*sampler, maxVertices, path, segments);
+				for(int k = 1; k < n; ++k){
+					const PathVertex& v = path[k];
+					vec3 facing = glm::dot(v.n, v.wo) > 0 ? v.n : -v.n;
+					deposited[w].push_back({v.p, facing, v.beta / float(numPhotons)});
+				}
+			}
+			delete sampler;
+		}));
+	}
+	for(thread& w : workers)
+		w.join();
+	delete photonSampler;
+
+	vector<Photon> photons;
+	for(const vector<Photon>& d : deposited)
+		photons.insert(photons.end(), d.begin(), d.end());
+
+	photonMap = new PhotonMap();
+	photonMap->Build(std::move(photons), numThreads);
+
+	cout << "Photon map: " << photonMap->Size() << " photons from " << numPhotons << " light paths ("
+	     << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s)" << endl;
+}
@@ -0,0 +1,121 @@
+#include <thinlens/photon/photonmap.h>
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+#define PI 3.141592653589793238462643383279502884
+
+namespace {
+    // photons on surfaces turned further away than this do not count
+    const float MIN_NORMAL_COSINE = 0.9f;
+    // ranges smaller than this are not worth a thread of their own
+    const int MIN_PARALLEL_PHOTONS = 1 << 16;
+
+    // the k nearest photons found so far, as a max-heap on distance
+    struct Query {
+        glm::vec3 p;
+        glm::vec3 n;
+        int k;
+        float maxDistance2;
+        int found;
+        std::pair<float, int> heap[PhotonMap::MAX_GATHER];
+    };
+
+    void Gather(const std::vector<Photon>& photons, const std::vector<uint8_t>& axes,
+                int begin, int end, Query& q) {
+        while (begin < end) {
+            int mid = begin + (end - begin) / 2;
+            const Photon& photon = photons[mid];
+            int axis = axes[mid];
+            float d = q.p[axis] - photon.p[axis];
+
+            // the side of the split the query point is on first
+            if (d < 0)
+                Gather(photons, axes, begin, mid, q);
+            else
+                Gather(photons, axes, mid + 1, end, q);
+
+            glm::vec3 offset = photon.p - q.p;
+            float dist2 = glm::dot(offset, offset);
+            if (dist2 < q.maxDistance2 && glm::dot(photon.n, q.n) > MIN_NORMAL_COSINE) {
+                if (q.found < q.k) {
+                    q.heap[q.found++] = std::make_pair(dist2, mid);
+                    std::push_heap(q.heap, q.heap + q.found);
+                } else {
+                    std::pop_heap(q.heap, q.heap + q.found);
+                    q.heap[q.found - 1] = std::make_pair(dist2, mid);
+                    std::push_heap(q.heap, q.heap + q.found);
+                }
+                if (q.found == q.k)
+                    q.maxDistance2 = q.heap[0].first;
+            }
+
+            // the other side, if the split plane is close enough
+            if (d * d >= q.maxDistance2)
+                return;
+            if (d < 0)
+                begin = mid + 1;
+            else
+                end = mid;
+        }
+    }
+};
+
+void PhotonMap::Build(std::vector<Photon> p, int numThreads) {
+    photons.swap(p);
+    axes.assign(photons.size(), 0);
+    Build(0, photons.size(), numThreads);
+}
+
+void PhotonMap::Build(int begin, int end, int numThreads) {
+    if (end - begin < 2) {
+        if (begin < end)
+            axes[begin] = 0;
+        return;
+    }
+
+    glm::vec3 pMin = photons[begin].p;
+    glm::vec3 pMax = pMin;
+    for (int i = begin + 1; i < end; ++i) {
+        pMin = glm::min(pMin, photons[i].p);
+        pMax = glm::max(pMax, photons[i].p);
+    }
+    glm::vec3 extent = pMax - pMin;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    int mid = begin + (end - begin) / 2;
+    std::nth_element(photons.begin() + begin, photons.begin() + mid, photons.begin() + end,
+                     [axis](const Photon& a, const Photon& b) { return a.p[axis] < b.p[axis]; });
+    axes[mid] = axis;
+
+    // the two halves are disjoint, so they can be built at the same time
+    if (numThreads > 1 && end - begin > MIN_PARALLEL_PHOTONS) {
+        std::thread left([this, begin, mid, numThreads]() { Build(begin, mid, numThreads / 2); });
+        Build(mid + 1, end, numThreads - numThreads / 2);
+        left.join();
+    } else {
+        Build(begin, mid, 1);
+        Build(mid + 1, end, 1);
+    }
+}
+
+glm::vec3 PhotonMap::Irradiance(const glm::vec3& p, const glm::vec3& n, int k, float maxDistance) const {
+    Query q;
+    q.p = p;
+    q.n = n;
+    q.k = std::max(1, std::min(k, int(MAX_GATHER)));
+    q.maxDistance2 = maxDistance * maxDistance;
+    q.found = 0;
+    Gather(photons, axes, 0, photons.size(), q);
+
+    glm::vec3 flux(0, 0, 0);
+    for (int i = 0; i < q.found; ++i)
+        flux += photons[q.heap[i].second].power;
+
+    // the disc that the photons were gathered from
+    float radius2 = q.found == q.k ? q.heap[0].first : maxDistance * maxDistance;
+    if (radius2 <= 0)
+        return glm::vec3(0, 0, 0);
+    return flux / (float(PI) * radius2);
+}
@@ -10,6 +10,11 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include <thinlens/camera/perspective.h>
+#include <thinlens/film/film.h>
+#include <thinlens/light/lightsampler.h>
+#include <thinlens/light/reservoir.h>
+#include <thinlens/sampler/bluenoise.h>
+#include <thinlens/scene/scene.h>
 #include <thinlens/auxiliaries/TestModel.h>
 #include <thinlens/auxiliaries/SDLauxiliary.h>
 
@@ -30,13 +35,23 @@ struct Intersection{
 // GLOBAL VARIABLES
 
 /* Screen variables */
-const int SCREEN_WIDTH = 480;
-const int SCREEN_HEIGHT = 240;
-bitmap_image image(SCREEN_WIDTH, SCREEN_HEIGHT);
+int screenWidth = 480;
+int screenHeight = 240;
+CropWindow crop = { 0, 0, 0, 0 }; // pixels that are traced, the whole window unless --crop is given
+bitmap_image image;
+Film film(0, 0); // the raster of the camera; frames are drawn straight to the screen
 SDL_Surface* screen;
 
 /* Time */
 int t;
+int frame = 0;
+
+/* 
+	Lens samples, one per pixel and frame. Blue-noise dithered, 
+	so that the depth of field noise of a single frame is fine 
+	grained instead of clumpy, and changes from frame to frame. 
+*/
+Sampler* sampler = new BlueNoiseSampler(1, 0);
 
 /* Camera state */ 
 float focalDistance = 0;
@@ -46,8 +61,8 @@ float pitch = 0;
 vec3 cameraPos( 0, 0, -3 );
 
 /* Setters for the pitch and yaw given mouse coordinates relative to the center of screen */
-#define PITCH(y, dt) (pitch += (SCREEN_HEIGHT / 2.0f - y) * PI * 0.001f * dt / (SCREEN_HEIGHT))
-#define YAW(x, dt) (yaw += (x - SCREEN_WIDTH / 2.0f) * PI * 0.001f * dt / (SCREEN_WIDTH))
+#define PITCH(y, dt) (pitch += (screenHeight / 2.0f - y) * PI * 0.001f * dt / (screenHeight))
+#define YAW(x, dt) (yaw += (x - screenWidth / 2.0f) * PI * 0.001f * dt / (screenWidth))
 
 mat4 rotation;
 mat3 R; // Y * P
@@ -60,36 +75,122 @@ mat3 P; // Pitch rotation matrix (around x axis)
 #define RIGHT(R) (R[0])
 #define UP(R) (R[1])
 
-/* Model */
+/* Model: as loaded, and laid out for tracing (rebuilt when the model changes) */
 vector<Triangle> triangles;
+Scene scene;
 
 /* Light source */
 vec3 lightPos( 0, -0.5, -0.7 );
 vec3 lightColor = 14.f * vec3( 1, 1, 1 );
 vec3 indirectLight = 0.5f*vec3( 1, 1, 1 );
 
+/* 
+	ReSTIR preview, toggled with R: direct light from a grid
+	of area lights below the ceiling (added to the model the
+	first time), resampled for every pixel from a few light 
+	samples, merged with the reservoir of the same surface 
+	in the previous frame and then with those of neighbouring
+	pixels. The merged reservoirs are kept for the next frame,
+	so the image converges while the camera stands still and
+	stays usable while it moves.
+*/
+struct ReservoirPixel {
+	bool hit;
+	vec3 p;
+	vec3 n; // facing the camera
+	vec3 albedo;
+	float depth;
+	vec3 emitted;
+	Reservoir reservoir;
+};
+bool restir = false;
+bool restirKeyDown = false;
+LightSampler* lightSampler = nullptr;
+Sampler* restirSampler = MakeSampler("independent", 1, 0);
+vector<ReservoirPixel> reservoirs;
+vector<ReservoirPixel> previousReservoirs;
+Camera* previousCamera = nullptr;
+const int RESTIR_LIGHTS = 4; // n x n
+const int RESTIR_CANDIDATES = 8;
+const int RESTIR_NEIGHBOURS = 3;
+const float RESTIR_RADIUS = 20; // pixels
+const float RESTIR_HISTORY = 20; // the previous frame counts for at most this many frames
+
 // ----------------------------------------------------------------------------
 // FUNCTIONS
 
+void Usage( const char* program );
 void Update();
 void Draw();
 bool ClosestIntersection(
 	vec3 start, 
 	vec3 dir,
-	const vector<Triangle>& triangles, 
+	const Scene& scene, 
 	Intersection& closestIntersection 
 );
 
 vec3 DirectLight( const Intersection& i );
+void ReSTIRInitial( int x, int y, const Ray& r );
+vec3 ReSTIRShade( int x, int y );
+bool Similar( const ReservoirPixel& a, const ReservoirPixel& b );
+bool Occluded( vec3 from, vec3 to );
+
+void Usage( const char* program ){
+	cerr << "Correct usage: " << program << " [options]" << endl;
+	cerr << "options:" << endl;
+	cerr << "  --resolution <w>x<h>        size of the window in pixels (default 480x240)" << endl;
+	cerr << "  --crop <x0>,<y0>,<x1>,<y1>  only trace the pixels [x0, x1) x [y0, y1)" << endl;
+}
 
 int main( int argc, char* argv[] )
 {
+	for( int a = 1; a < argc; ++a ){
+		string option = argv[a];
+		if( a + 1 >= argc ){
+			cerr << "missing value for option " << option << endl;
+			Usage(argv[0]);
+			return -1;
+		}
+		string value = argv[++a];
+
+		bool valid;
+		if( option == "--resolution" ){
+			valid = ParseResolution(value, screenWidth, screenHeight);
+		} else if( option == "--crop" ){
+			valid = ParseCropWindow(value, crop);
+		} else {
+			cerr << "unknown option " << option << endl;
+			Usage(argv[0]);
+			return -1;
+		}
+
+		if( !valid ){
+			cerr << "invalid value for option " << option << endl;
+			Usage(argv[0]);
+			return -1;
+		}
+	}
+
+	// an empty window is the default, the whole frame
+	if( crop.x1 == 0 ){
+		crop = { 0, 0, screenWidth, screenHeight };
+	} else if( crop.x1 > screenWidth || crop.y1 > screenHeight ){
+		cerr << "the crop window must lie within the " << screenWidth << "x" << screenHeight << " frame" << endl;
+		return -1;
+	}
+
+	image.setwidth_height(screenWidth, screenHeight, true);
+	film = Film(screenWidth, screenHeight);
+	reservoirs.resize(size_t(screenWidth) * screenHeight);
+	previousReservoirs.resize(size_t(screenWidth) * screenHeight);
+
 	srand(time(NULL));
 
 	// load model
 	LoadTestModel(triangles);
+	scene = Scene(triangles);
 
-	screen = InitializeSDL( SCREEN_WIDTH, SCREEN_HEIGHT );
+	screen = InitializeSDL( screenWidth, screenHeight );
 	t = SDL_GetTicks();	// Set start value for timer.
 
 	while( NoQuitMessageSDL() )
@@ -127,6 +228,19 @@ void Update()
 
 	Uint8* keystate = SDL_GetKeyState( 0 );
 
+	if( keystate[SDLK_r] && !restirKeyDown ){
+		restir = !restir;
+		if( restir && !lightSampler ){
+			AddCeilingLights(triangles, RESTIR_LIGHTS, 15.f * vec3(1, 1, 1));
+			lightSampler = MakeLightSampler("power", triangles);
+			scene = Scene(triangles);
+		}
+		// no history from before the switch
+		delete previousCamera;
+		previousCamera = nullptr;
+	}
+	restirKeyDown = keystate[SDLK_r];
+
 	if( keystate[SDLK_RIGHT] )
 		lensRadius += 0.007f;
 
@@ -192,7 +306,7 @@ void Draw()
 
 	// scale a "basically unit" image plane according to raster ratio
 	mat2 screenWindow = mat2();
-    float ratio = float(SCREEN_WIDTH)/SCREEN_HEIGHT;
+    float ratio = float(screenWidth)/screenHeight;
 
     screenWindow[0][0] = -ratio;
     screenWindow[0][1] = -1; // bottom left corner of window on image plane in screen space
@@ -200,16 +314,17 @@ void Draw()
     screenWindow[1][0] = 2*ratio;
     screenWindow[1][1] = 2; // width and height of window on image plane in screen space
 	
-	Camera* c = new PerspectiveCamera(cameraToWorld, screenWindow, 0, 10, lensRadius, focalDistance, 50, image);
-    for( int y=0; y<SCREEN_HEIGHT; ++y )
+	Camera* c = new PerspectiveCamera(cameraToWorld, screenWindow, 0, 10, lensRadius, focalDistance, 50, film);
+    for( int y=crop.y0; y<crop.y1; ++y )
 	{
-		for( int x=0; x<SCREEN_WIDTH; ++x )
+		for( int x=crop.x0; x<crop.x1; ++x )
 		{
 
 			CameraSample sample;
 			sample.pFilm = vec2(x + 0.5, y + 0.5);
 			sample.time = 0;
-			sample.pLens = vec2(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+			sampler->StartPixelSample(x, y, frame);
+			sample.pLens = sampler->Get2D();
 
 			Ray r;
 
@@ -217,17 +332,22 @@ void Draw()
 
 			// cout << "vec4(" << r.d.x << "," << r.d.y << "," << r.d.z << "," << r.d.w << ")" << endl;
 
+			if( restir ){
+				ReSTIRInitial(x, y, r);
+				continue;
+			}
+
 			vec3 color( 0, 0, 0 );
 			Intersection inter;
-			if(ClosestIntersection(vec3(r.o.x, r.o.y, r.o.z), vec3(r.d.x, r.d.y, r.d.z), triangles, inter)){
+			if(ClosestIntersection(vec3(r.o.x, r.o.y, r.o.z), vec3(r.d.x, r.d.y, r.d.z), scene, inter)){
                 // This is the sequential form of division by numSamples.
                 // connect() calculates a multi-sample estimator from 
                 // the two paths using multiple importance sampling 
                 // with the balance heuristic.
 
-                vec3 color = glm::clamp(glm::clamp(255.f * DirectLight(inter), 0, 255.f) + 255.f * triangles[inter.triangleIndex].color * indirectLight, 0, 255);
+                vec3 color = glm::clamp(glm::clamp(255.f * DirectLight(inter), 0, 255.f) + 255.f * scene.GetMaterial(inter.triangleIndex).color * indirectLight, 0, 255);
                 image.set_pixel(x, y, color.r, color.g, color.b);
-				PutPixelSDL(screen, x, y, DirectLight(inter) + triangles[inter.triangleIndex].color * indirectLight);
+				PutPixelSDL(screen, x, y, DirectLight(inter) + scene.GetMaterial(inter.triangleIndex).color * indirectLight);
 			} else {
                 image.set_pixel(x, y, color.r, color.g, color.b);
 				PutPixelSDL(screen, x, y, vec3(0, 0, 0));
@@ -235,49 +355,36 @@ void Draw()
 		}
 	}
 
+	// spatial reuse needs the reservoirs of all pixels of the frame
+	if( restir ){
+		for( int y=crop.y0; y<crop.y1; ++y ){
+			for( int x=crop.x0; x<crop.x1; ++x ){
+				vec3 color = ReSTIRShade(x, y);
+				vec3 pixel = glm::clamp(255.f * color, 0.f, 255.f);
+				image.set_pixel(x, y, pixel.r, pixel.g, pixel.b);
+				PutPixelSDL(screen, x, y, color);
+			}
+		}
+	}
+
 	if( SDL_MUSTLOCK(screen) )
 		SDL_UnlockSurface(screen);
 
 	SDL_UpdateRect( screen, 0, 0, 0, 0 );
+	++frame;
+
+	delete previousCamera;
+	previousCamera = c;
 }
 
 bool ClosestIntersection(
 	vec3 start, 
 	vec3 dir,
-	const vector<Triangle>& triangles, 
+	const Scene& scene, 
 	Intersection& closestIntersection 
 ){
-	closestIntersection.distance = std::numeric_limits<float>::max();
-	dir = glm::normalize(dir); // does not matter what you do here, the t aka x.x will adjust the length. No need to normalize
-
-	for(int i = 0; i < triangles.size(); ++i){
-		const Triangle & triangle = triangles[i];
-		using glm::vec3;
-		using glm::mat3;
-		vec3 v0 = triangle.v0;
-		vec3 v1 = triangle.v1; 
-		vec3 v2 = triangle.v2;
-		vec3 e1 = v1 - v0;
-		vec3 e2 = v2 - v0;
-		vec3 b = start - v0;
-		mat3 A( -dir, e1, e2 );
-		vec3 x = glm::inverse( A ) * b;
-
-		if(x.x > 0 && x.y >= 0 && x.z >= 0 && x.y <= 1 && x.z <= 1 && x.y + x.z <= 1){
-
-			vec3 end = start + x.x * dir;
-			float distance = glm::length(x.x * dir);
-			if(distance < closestIntersection.distance){
-				closestIntersection = {end, distance, i}; // element-wise copy assignment
-			}
-		}
-	}
-
-	if(closestIntersection.distance == std::numeric_limits<float>::max()){
-		return false;
-	} else {
-		return true;
-	}
+	return scene.Intersect(start, dir, closestIntersection.triangleIndex, 
+	                       closestIntersection.position, closestIntersection.distance);
 }
 
 vec3 DirectLight( const Intersection& i ){
@@ -307,7 +414,8 @@ vec3 DirectLight( const Intersection& i ){
 	*/
 
 	vec3 sourceToLight = cameraPos - i.position;
-	vec3 normal = glm::dot(sourceToLight, triangles[i.triangleIndex].normal) * triangles[i.triangleIndex].normal / glm::dot(triangles[i.triangleIndex].normal, triangles[i.triangleIndex].normal);
+	vec3 surfaceNormal = scene.Normal(i.triangleIndex);
+	vec3 normal = glm::dot(sourceToLight, surfaceNormal) * surfaceNormal / glm::dot(surfaceNormal, surfaceNormal);
 	normal = glm::normalize(normal);
 
 	/*
@@ -319,9 +427,124 @@ vec3 DirectLight( const Intersection& i ){
 	*/
 
 	Intersection blocker;
-	if(ClosestIntersection(i.position + normal * 0.0001f, (lightPos - i.position), triangles, blocker) && glm::length(blocker.position - i.position) <= glm::length(lightPos-i.position)){
+	if(ClosestIntersection(i.position + normal * 0.0001f, (lightPos - i.position), scene, blocker) && glm::length(blocker.position - i.position) <= glm::length(lightPos-i.position)){
 		return vec3(0, 0, 0);
 	} else {
-		return triangles[i.triangleIndex].color * light * (glm::dot(radius, normal) > 0.0f ? glm::dot(radius, normal) : 0.0f);
+		return scene.GetMaterial(i.triangleIndex).color * light * (glm::dot(radius, normal) > 0.0f ? glm::dot(radius, normal) : 0.0f);
+	}
+}
+bool Occluded( vec3 from, vec3 to ){
+	Intersection blocker;
+	return ClosestIntersection(from, to - from, scene, blocker) && blocker.distance < glm::length(to - from) * (1 - 1e-4f);
+}
+
+bool Similar( const ReservoirPixel& a, const ReservoirPixel& b ){
+	return a.hit && b.hit && glm::dot(a.n, b.n) > 0.9f && std::abs(a.depth - b.depth) < 0.1f * a.depth;
+}
+
+/*
+	Resamples light samples for the first surface pixel 
+	(x, y) sees along r, and merges the reservoir of where 
+	that surface was in the previous frame. Occluded samples
+	are dropped, so that they are not passed on.
+*/
+void ReSTIRInitial( int x, int y, const Ray& r ){
+	ReservoirPixel& pixel = reservoirs[size_t(y) * screenWidth + x];
+	pixel.reservoir = Reservoir();
+
+	vec3 origin(r.o.x, r.o.y, r.o.z);
+	vec3 dir = glm::normalize(vec3(r.d.x, r.d.y, r.d.z));
+	Intersection i;
+	pixel.hit = ClosestIntersection(origin, dir, scene, i);
+	if( !pixel.hit )
+		return;
+
+	const Material& material = scene.GetMaterial(i.triangleIndex);
+	vec3 normal = scene.Normal(i.triangleIndex);
+	pixel.p = i.position;
+	pixel.n = glm::dot(normal, dir) < 0 ? normal : -normal;
+	pixel.albedo = material.color;
+	pixel.depth = i.distance;
+	pixel.emitted = glm::dot(normal, dir) < 0 ? material.emittance : vec3(0, 0, 0);
+
+	Reservoir& reservoir = pixel.reservoir;
+	restirSampler->StartPixelSample(x, y, frame);
+	for( int k=0; k<RESTIR_CANDIDATES; ++k ){
+		float uLight = restirSampler->Get1D();
+		vec2 uPoint = restirSampler->Get2D();
+		float u = restirSampler->Get1D();
+
+		LightSample ls;
+		if( lightSampler->Sample(pixel.p, pixel.n, uLight, uPoint, ls) )
+			reservoir.Update(ls, TargetPdf(pixel.p, pixel.n, pixel.albedo, ls) / ls.pdf, u);
+		else
+			reservoir.M += 1;
 	}
-}
\ No newline at end of file
+	reservoir.Finalize(TargetPdf(pixel.p, pixel.n, pixel.albedo, reservoir.sample));
+	if( reservoir.W > 0 && Occluded(pixel.p + 1e-4f * pixel.n, reservoir.sample.position) )
+		reservoir.W = 0;
+
+	// temporal reuse: where the previous camera saw this point
+	vec3 wi, pLens;
+	float pdf;
+	vec2 pRaster;
+	if( previousCamera && previousCamera->SampleWi(pixel.p, vec2(0.5f, 0.5f), wi, pLens, pdf, pRaster) > 0 ){
+		int px = int(pRaster.x);
+		int py = int(pRaster.y);
+		if( px >= crop.x0 && py >= crop.y0 && px < crop.x1 && py < crop.y1 ){
+			ReservoirPixel previous = previousReservoirs[size_t(py) * screenWidth + px];
+
+			// the depth of this point as the previous camera saw it
+			ReservoirPixel here = pixel;
+			here.depth = glm::length(pixel.p - pLens);
+			if( Similar(previous, here) ){
+				previous.reservoir.M = std::min(previous.reservoir.M, RESTIR_HISTORY * RESTIR_CANDIDATES);
+				reservoir.Merge(previous.reservoir, TargetPdf(pixel.p, pixel.n, pixel.albedo, previous.reservoir.sample), restirSampler->Get1D());
+				reservoir.Finalize(TargetPdf(pixel.p, pixel.n, pixel.albedo, reservoir.sample));
+			}
+		}
+	}
+}
+
+/*
+	Merges the reservoir of pixel (x, y) with those of 
+	similar pixels nearby and shades it: the direct light
+	from the merged sample, plus emission and the constant
+	indirect light of the classic mode.
+*/
+vec3 ReSTIRShade( int x, int y ){
+	const ReservoirPixel& center = reservoirs[size_t(y) * screenWidth + x];
+	if( !center.hit )
+		return vec3(0, 0, 0);
+
+	restirSampler->StartPixelSample(x, y, frame, 4 * RESTIR_CANDIDATES + 1);
+	Reservoir r;
+	r.Merge(center.reservoir, TargetPdf(center.p, center.n, center.albedo, center.reservoir.sample), restirSampler->Get1D());
+	for( int k=0; k<RESTIR_NEIGHBOURS; ++k ){
+		vec2 u = restirSampler->Get2D();
+		float radius = RESTIR_RADIUS * std::sqrt(u.x);
+		int nx = x + int(radius * std::cos(2 * PI * u.y));
+		int ny = y + int(radius * std::sin(2 * PI * u.y));
+		float uMerge = restirSampler->Get1D();
+		if( nx < crop.x0 || ny < crop.y0 || nx >= crop.x1 || ny >= crop.y1 || (nx == x && ny == y) )
+			continue;
+
+		const ReservoirPixel& q = reservoirs[size_t(ny) * screenWidth + nx];
+		if( Similar(center, q) )
+			r.Merge(q.reservoir, TargetPdf(center.p, center.n, center.albedo, q.reservoir.sample), uMerge);
+	}
+	r.Finalize(TargetPdf(center.p, center.n, center.albedo, r.sample));
+
+	vec3 direct(0, 0, 0);
+	if( r.W > 0 && !Occluded(center.p + 1e-4f * center.n, r.sample.position) )
+		direct = UnshadowedLight(center.p, center.n, center.albedo, r.sample) * r.W;
+	else
+		r.W = 0;
+
+	// the merged reservoir is the history of the next frame
+	ReservoirPixel& next = previousReservoirs[size_t(y) * screenWidth + x];
+	next = center;
+	next.reservoir = r;
+
+	return center.emitted + direct + center.albedo * indirectLight;
+}
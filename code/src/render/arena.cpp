@@ -0,0 +1,62 @@
+#include <thinlens/render/arena.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+    const size_t ALIGNMENT = 16;
+};
+
+MemoryArena::MemoryArena(size_t blockSize)
+    : blockSize(blockSize), current{nullptr, 0}, currentPos(0) {}
+
+MemoryArena::~MemoryArena() {
+    std::free(current.memory);
+    for (const Block& b : used)
+        std::free(b.memory);
+    for (const Block& b : available)
+        std::free(b.memory);
+}
+
+void* MemoryArena::Alloc(size_t bytes) {
+    bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    if (currentPos + bytes > current.size) {
+        if (current.memory)
+            used.push_back(current);
+
+        // reuse a free block if one is large enough
+        current = Block{nullptr, 0};
+        for (size_t i = 0; i < available.size(); ++i) {
+            if (available[i].size >= bytes) {
+                current = available[i];
+                available.erase(available.begin() + i);
+                break;
+            }
+        }
+        if (!current.memory) {
+            size_t size = std::max(bytes, blockSize);
+            current = Block{static_cast<unsigned char*>(std::malloc(size)), size};
+        }
+        currentPos = 0;
+    }
+
+    void* p = current.memory + currentPos;
+    currentPos += bytes;
+    return p;
+}
+
+void MemoryArena::Reset() {
+    currentPos = 0;
+    available.insert(available.end(), used.begin(), used.end());
+    used.clear();
+}
+
+size_t MemoryArena::TotalAllocated() const {
+    size_t total = current.size;
+    for (const Block& b : used)
+        total += b.size;
+    for (const Block& b : available)
+        total += b.size;
+    return total;
+}
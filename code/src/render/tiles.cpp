@@ -0,0 +1,126 @@
+#include <thinlens/render/tiles.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+    /*
+        Position of (x, y) along a Hilbert curve filling an
+        n x n grid, n a power of two.
+    */
+    uint64_t HilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+        uint64_t d = 0;
+        for (uint32_t s = n / 2; s > 0; s /= 2) {
+            uint32_t rx = (x & s) > 0;
+            uint32_t ry = (y & s) > 0;
+            d += uint64_t(s) * s * ((3 * rx) ^ ry);
+
+            // rotate the quadrant so that the curve stays continuous
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+};
+
+bool ParseTileOrder(const std::string& name, TileOrder& order) {
+    if (name == "scanline") {
+        order = TileOrder::Scanline;
+    } else if (name == "hilbert") {
+        order = TileOrder::Hilbert;
+    } else if (name == "spiral") {
+        order = TileOrder::Spiral;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<Tile> MakeTiles(int width, int height, int tileSize, TileOrder order) {
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+
+    std::vector<Tile> tiles;
+    tiles.reserve(tilesX * tilesY);
+    for (int ty = 0; ty < tilesY; ++ty) {
+        for (int tx = 0; tx < tilesX; ++tx) {
+            Tile t;
+            t.x0 = tx * tileSize;
+            t.y0 = ty * tileSize;
+            t.x1 = std::min(t.x0 + tileSize, width);
+            t.y1 = std::min(t.y0 + tileSize, height);
+            t.index = ty * tilesX + tx;
+            tiles.push_back(t);
+        }
+    }
+
+    if (order == TileOrder::Hilbert) {
+        uint32_t n = 1;
+        while (n < uint32_t(std::max(tilesX, tilesY)))
+            n *= 2;
+
+        std::vector<std::pair<uint64_t, Tile>> keyed;
+        for (const Tile& t : tiles)
+            keyed.push_back(std::make_pair(HilbertIndex(n, t.index % tilesX, t.index / tilesX), t));
+        std::sort(keyed.begin(), keyed.end(),
+            [](const std::pair<uint64_t, Tile>& a, const std::pair<uint64_t, Tile>& b) { return a.first < b.first; });
+
+        for (size_t i = 0; i < tiles.size(); ++i)
+            tiles[i] = keyed[i].second;
+    } else if (order == TileOrder::Spiral) {
+        // rings of tiles around the centre, each ring walked by angle
+        float cx = 0.5f * width;
+        float cy = 0.5f * height;
+        auto ring = [&](const Tile& t) {
+            float dx = std::abs(0.5f * (t.x0 + t.x1) - cx) / tileSize;
+            float dy = std::abs(0.5f * (t.y0 + t.y1) - cy) / tileSize;
+            return int(std::floor(std::max(dx, dy) + 0.5f));
+        };
+        auto angle = [&](const Tile& t) {
+            return std::atan2(0.5f * (t.y0 + t.y1) - cy, 0.5f * (t.x0 + t.x1) - cx);
+        };
+        std::stable_sort(tiles.begin(), tiles.end(), [&](const Tile& a, const Tile& b) {
+            int ra = ring(a);
+            int rb = ring(b);
+            if (ra != rb)
+                return ra < rb;
+            return angle(a) < angle(b);
+        });
+    }
+
+    return tiles;
+}
+
+std::vector<Tile> CropTiles(const std::vector<Tile>& tiles, int x0, int y0, int x1, int y1) {
+    std::vector<Tile> cropped;
+    for (Tile t : tiles) {
+        t.x0 = std::max(t.x0, x0);
+        t.y0 = std::max(t.y0, y0);
+        t.x1 = std::min(t.x1, x1);
+        t.y1 = std::min(t.y1, y1);
+        if (t.x0 < t.x1 && t.y0 < t.y1)
+            cropped.push_back(t);
+    }
+    return cropped;
+}
+
+TileScheduler::TileScheduler(const std::vector<Tile>& tiles) : tiles(tiles), next(0) {}
+
+void TileScheduler::Reset() {
+    next = 0;
+}
+
+bool TileScheduler::Next(Tile& tile) {
+    size_t i = next.fetch_add(1);
+    if (i >= tiles.size())
+        return false;
+
+    tile = tiles[i];
+    return true;
+}
@@ -0,0 +1,145 @@
+#include <thinlens/sampler/bluenoise.h>
+#include <thinlens/sampler/lowdiscrepancy.h>
+
+#include <cmath>
+
+namespace {
+    const int N = BlueNoiseTile::SIZE;
+    const float SIGMA = 1.5f;
+
+    /*
+        Energy of every pixel: a Gaussian-weighted count of
+        the set pixels around it, on the torus. Kept up to 
+        date incrementally as pixels are set and cleared.
+    */
+    struct EnergyField {
+        std::vector<float> kernel; // indexed by toroidal offset
+        std::vector<float> energy;
+        std::vector<char> set;
+
+        EnergyField() : kernel(N * N), energy(N * N, 0), set(N * N, 0) {
+            for (int dy = 0; dy < N; ++dy) {
+                for (int dx = 0; dx < N; ++dx) {
+                    int ox = std::min(dx, N - dx);
+                    int oy = std::min(dy, N - dy);
+                    kernel[dy * N + dx] = std::exp(-(ox * ox + oy * oy) / (2 * SIGMA * SIGMA));
+                }
+            }
+        }
+
+        void Toggle(int p) {
+            float sign = set[p] ? -1.f : 1.f;
+            set[p] = !set[p];
+            int px = p % N, py = p / N;
+            for (int y = 0; y < N; ++y) {
+                int dy = (y - py + N) & (N - 1);
+                for (int x = 0; x < N; ++x) {
+                    int dx = (x - px + N) & (N - 1);
+                    energy[y * N + x] += sign * kernel[dy * N + dx];
+                }
+            }
+        }
+
+        // densest set pixel
+        int TightestCluster() const {
+            int best = -1;
+            for (int p = 0; p < N * N; ++p)
+                if (set[p] && (best < 0 || energy[p] > energy[best]))
+                    best = p;
+            return best;
+        }
+
+        // emptiest unset pixel
+        int LargestVoid() const {
+            int best = -1;
+            for (int p = 0; p < N * N; ++p)
+                if (!set[p] && (best < 0 || energy[p] < energy[best]))
+                    best = p;
+            return best;
+        }
+    };
+};
+
+const BlueNoiseTile& BlueNoiseTile::Get() {
+    static const BlueNoiseTile tile;
+    return tile;
+}
+
+BlueNoiseTile::BlueNoiseTile() : values(N * N) {
+    std::vector<int> rank(N * N, -1);
+    EnergyField field;
+
+    // initial binary pattern: random points, relaxed until the
+    // tightest cluster is also the largest void
+    PCG32 rng(0x626c7565);
+    int initial = N * N / 10;
+    for (int i = 0; i < initial; ) {
+        int p = rng.Next() % (N * N);
+        if (!field.set[p]) {
+            field.Toggle(p);
+            ++i;
+        }
+    }
+    for (;;) {
+        int cluster = field.TightestCluster();
+        field.Toggle(cluster);
+        int gap = field.LargestVoid();
+        field.Toggle(gap);
+        if (gap == cluster)
+            break;
+    }
+    std::vector<char> prototype = field.set;
+    std::vector<float> prototypeEnergy = field.energy;
+
+    // phase 1: rank the initial points by removing tightest clusters
+    for (int r = initial - 1; r >= 0; --r) {
+        int cluster = field.TightestCluster();
+        field.Toggle(cluster);
+        rank[cluster] = r;
+    }
+
+    // phases 2 and 3: rank the remaining pixels by filling the largest voids
+    field.set = prototype;
+    field.energy = prototypeEnergy;
+    for (int r = initial; r < N * N; ++r) {
+        int gap = field.LargestVoid();
+        field.Toggle(gap);
+        rank[gap] = r;
+    }
+
+    for (int p = 0; p < N * N; ++p)
+        values[p] = (rank[p] + 0.5f) / (N * N);
+}
+
+BlueNoiseSampler::BlueNoiseSampler(int samplesPerPixel, uint64_t seed)
+    : Sampler(samplesPerPixel, seed), tile(BlueNoiseTile::Get()) {}
+
+float BlueNoiseSampler::Shift(float u, int dim) const {
+    uint64_t h = Hash({uint64_t(dim), seed});
+    float offset = tile(px + int(h & 0xffff), py + int((h >> 16) & 0xffff));
+    u += offset;
+    return std::min(u >= 1 ? u - 1 : u, ONE_MINUS_EPSILON);
+}
+
+float BlueNoiseSampler::Get1D() {
+    // the same scramble for every pixel; pixels only differ by their shift
+    uint64_t h = Hash({uint64_t(dimension), seed});
+    uint32_t x = NestedUniformScramble(Sobol32(uint32_t(sampleIndex), 0), uint32_t(h));
+    float u = Shift(x * TWO_TO_MINUS_32, dimension);
+    ++dimension;
+    return u;
+}
+
+glm::vec2 BlueNoiseSampler::Get2D() {
+    uint64_t h = Hash({uint64_t(dimension), seed});
+    uint32_t index = NestedUniformScramble(uint32_t(sampleIndex), uint32_t(h >> 32));
+    uint32_t x = NestedUniformScramble(Sobol32(index, 0), uint32_t(MixBits(h ^ 0)));
+    uint32_t y = NestedUniformScramble(Sobol32(index, 1), uint32_t(MixBits(h ^ 1)));
+    glm::vec2 u(Shift(x * TWO_TO_MINUS_32, dimension), Shift(y * TWO_TO_MINUS_32, dimension + 1));
+    dimension += 2;
+    return u;
+}
+
+Sampler* BlueNoiseSampler::Clone() const {
+    return new BlueNoiseSampler(*this);
+}
@@ -0,0 +1,30 @@
+#include <thinlens/sampler/halton.h>
+#include <thinlens/sampler/lowdiscrepancy.h>
+
+namespace {
+    const int PRIMES[] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+        59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+        137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223
+    };
+    const int NUM_PRIMES = sizeof(PRIMES) / sizeof(PRIMES[0]);
+};
+
+HaltonSampler::HaltonSampler(int samplesPerPixel, uint64_t seed)
+    : Sampler(samplesPerPixel, seed) {}
+
+float HaltonSampler::Get1D() {
+    uint64_t h = Hash({uint64_t(px), uint64_t(py), uint64_t(dimension), seed});
+    float u = OwenScrambledRadicalInverse(PRIMES[dimension % NUM_PRIMES], sampleIndex, uint32_t(h));
+    ++dimension;
+    return u;
+}
+
+glm::vec2 HaltonSampler::Get2D() {
+    float u = Get1D();
+    return glm::vec2(u, Get1D());
+}
+
+Sampler* HaltonSampler::Clone() const {
+    return new HaltonSampler(*this);
+}
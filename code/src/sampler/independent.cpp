@@ -0,0 +1,24 @@
+#include <thinlens/sampler/independent.h>
+
+IndependentSampler::IndependentSampler(int samplesPerPixel, uint64_t seed)
+    : Sampler(samplesPerPixel, seed) {}
+
+void IndependentSampler::SetDimension(int dim) {
+    Sampler::SetDimension(dim);
+    rng.SetSequence(Hash({uint64_t(px), uint64_t(py), uint64_t(sampleIndex), uint64_t(dim)}), seed);
+}
+
+float IndependentSampler::Get1D() {
+    ++dimension;
+    return rng.Uniform();
+}
+
+glm::vec2 IndependentSampler::Get2D() {
+    dimension += 2;
+    float u = rng.Uniform();
+    return glm::vec2(u, rng.Uniform());
+}
+
+Sampler* IndependentSampler::Clone() const {
+    return new IndependentSampler(*this);
+}
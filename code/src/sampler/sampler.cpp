@@ -0,0 +1,36 @@
+#include <thinlens/sampler/sampler.h>
+#include <thinlens/sampler/independent.h>
+#include <thinlens/sampler/stratified.h>
+#include <thinlens/sampler/halton.h>
+#include <thinlens/sampler/sobol.h>
+#include <thinlens/sampler/bluenoise.h>
+
+Sampler::Sampler(int samplesPerPixel, uint64_t seed)
+    : samplesPerPixel(samplesPerPixel), seed(seed), px(0), py(0), sampleIndex(0), dimension(0) {}
+
+Sampler::~Sampler() {}
+
+void Sampler::StartPixelSample(int x, int y, int index, int dim) {
+    px = x;
+    py = y;
+    sampleIndex = index;
+    SetDimension(dim);
+}
+
+void Sampler::SetDimension(int dim) {
+    dimension = dim;
+}
+
+Sampler* MakeSampler(const std::string& name, int samplesPerPixel, uint64_t seed) {
+    if (name == "independent")
+        return new IndependentSampler(samplesPerPixel, seed);
+    if (name == "stratified")
+        return new StratifiedSampler(samplesPerPixel, seed);
+    if (name == "halton")
+        return new HaltonSampler(samplesPerPixel, seed);
+    if (name == "sobol")
+        return new SobolSampler(samplesPerPixel, seed);
+    if (name == "bluenoise")
+        return new BlueNoiseSampler(samplesPerPixel, seed);
+    return nullptr;
+}
@@ -0,0 +1,29 @@
+#include <thinlens/sampler/sobol.h>
+#include <thinlens/sampler/lowdiscrepancy.h>
+
+SobolSampler::SobolSampler(int samplesPerPixel, uint64_t seed)
+    : Sampler(samplesPerPixel, seed) {}
+
+float SobolSampler::Get1D() {
+    uint64_t h = Hash({uint64_t(px), uint64_t(py), uint64_t(dimension), seed});
+    ++dimension;
+
+    uint32_t index = NestedUniformScramble(uint32_t(sampleIndex), uint32_t(h));
+    uint32_t x = NestedUniformScramble(Sobol32(index, 0), uint32_t(h >> 32));
+    return std::min(x * TWO_TO_MINUS_32, ONE_MINUS_EPSILON);
+}
+
+glm::vec2 SobolSampler::Get2D() {
+    uint64_t h = Hash({uint64_t(px), uint64_t(py), uint64_t(dimension), seed});
+    dimension += 2;
+
+    uint32_t index = NestedUniformScramble(uint32_t(sampleIndex), uint32_t(h));
+    uint32_t x = NestedUniformScramble(Sobol32(index, 0), uint32_t(MixBits(h ^ 0)));
+    uint32_t y = NestedUniformScramble(Sobol32(index, 1), uint32_t(MixBits(h ^ 1)));
+    return glm::vec2(std::min(x * TWO_TO_MINUS_32, ONE_MINUS_EPSILON),
+                     std::min(y * TWO_TO_MINUS_32, ONE_MINUS_EPSILON));
+}
+
+Sampler* SobolSampler::Clone() const {
+    return new SobolSampler(*this);
+}
@@ -0,0 +1,44 @@
+#include <thinlens/sampler/stratified.h>
+#include <thinlens/sampler/lowdiscrepancy.h>
+
+#include <cmath>
+
+StratifiedSampler::StratifiedSampler(int samplesPerPixel, uint64_t seed)
+    : Sampler(samplesPerPixel, seed), xStrata(1), yStrata(samplesPerPixel)
+{
+    // the most square grid of strata that has exactly one sample per stratum
+    for (int x = int(std::sqrt(float(samplesPerPixel))); x >= 1; --x) {
+        if (samplesPerPixel % x == 0) {
+            xStrata = samplesPerPixel / x;
+            yStrata = x;
+            break;
+        }
+    }
+}
+
+float StratifiedSampler::Get1D() {
+    int round = sampleIndex / samplesPerPixel;
+    uint64_t h = Hash({uint64_t(px), uint64_t(py), uint64_t(dimension), uint64_t(round), seed});
+    int stratum = PermutationElement(sampleIndex % samplesPerPixel, samplesPerPixel, uint32_t(h));
+    ++dimension;
+
+    PCG32 rng(h >> 32, uint64_t(sampleIndex));
+    return std::min((stratum + rng.Uniform()) / samplesPerPixel, ONE_MINUS_EPSILON);
+}
+
+glm::vec2 StratifiedSampler::Get2D() {
+    int round = sampleIndex / samplesPerPixel;
+    uint64_t h = Hash({uint64_t(px), uint64_t(py), uint64_t(dimension), uint64_t(round), seed});
+    int stratum = PermutationElement(sampleIndex % samplesPerPixel, samplesPerPixel, uint32_t(h));
+    dimension += 2;
+
+    PCG32 rng(h >> 32, uint64_t(sampleIndex));
+    float dx = rng.Uniform();
+    float dy = rng.Uniform();
+    return glm::vec2(std::min((stratum % xStrata + dx) / xStrata, ONE_MINUS_EPSILON),
+                     std::min((stratum / xStrata + dy) / yStrata, ONE_MINUS_EPSILON));
+}
+
+Sampler* StratifiedSampler::Clone() const {
+    return new StratifiedSampler(*this);
+}
@@ -0,0 +1,82 @@
+#include <thinlens/scene/mesh.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+void Mesh::Bounds(glm::vec3& pMin, glm::vec3& pMax) const {
+    pMin = glm::vec3(std::numeric_limits<float>::max());
+    pMax = glm::vec3(-std::numeric_limits<float>::max());
+    for (const glm::vec3& p : positions) {
+        pMin = glm::min(pMin, p);
+        pMax = glm::max(pMax, p);
+    }
+}
+
+bool LoadOBJ(const std::string& path, Mesh& mesh) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        std::cerr << "could not open model " << path << std::endl;
+        return false;
+    }
+
+    mesh.positions.clear();
+    mesh.indices.clear();
+
+    char line[4096];
+    int lineNumber = 0;
+    std::vector<uint32_t> face;
+    while (fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+        const char* c = line;
+        while (*c == ' ' || *c == '\t')
+            ++c;
+
+        if (c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+            char* end;
+            glm::vec3 p;
+            p.x = strtof(c + 2, &end);
+            p.y = strtof(end, &end);
+            p.z = strtof(end, &end);
+            mesh.positions.push_back(p);
+        } else if (c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+            // vertices are v, v/vt, v//vn or v/vt/vn; only v matters
+            face.clear();
+            c += 2;
+            while (true) {
+                char* end;
+                long index = strtol(c, &end, 10);
+                if (end == c)
+                    break;
+
+                // negative indices count back from the last vertex so far
+                long resolved = index < 0 ? long(mesh.positions.size()) + index : index - 1;
+                if (index == 0 || resolved < 0 || resolved >= long(mesh.positions.size())) {
+                    std::cerr << path << ":" << lineNumber << ": face refers to a missing vertex" << std::endl;
+                    fclose(file);
+                    return false;
+                }
+                face.push_back(uint32_t(resolved));
+
+                c = end;
+                while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+                    ++c;
+            }
+
+            for (size_t i = 2; i < face.size(); ++i) {
+                mesh.indices.push_back(face[0]);
+                mesh.indices.push_back(face[i - 1]);
+                mesh.indices.push_back(face[i]);
+            }
+        }
+    }
+
+    fclose(file);
+    if (mesh.indices.empty()) {
+        std::cerr << "model " << path << " has no faces" << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,367 @@
+#include <thinlens/scene/scene.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <utility>
+
+namespace {
+    // buckets the centroids are sorted into when looking for a split
+    const int SAH_BUCKETS = 16;
+    // triangles a leaf may hold; more are always split
+    const uint32_t MAX_LEAF_SIZE = 8;
+    // cost of visiting a node, relative to testing a triangle
+    const float TRAVERSAL_COST = 1.f;
+    const int STACK_SIZE = 128;
+
+    typedef std::pair<std::pair<float, float>, float> Key3;
+
+    Key3 MakeKey(const glm::vec3& v) {
+        return std::make_pair(std::make_pair(v.x, v.y), v.z);
+    }
+
+    float SurfaceArea(const glm::vec3& pMin, const glm::vec3& pMax) {
+        glm::vec3 d = pMax - pMin;
+        return d.x < 0 ? 0 : 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    /*
+        Whether the ray enters the box before tMax. NaNs, from a
+        ray in the plane of a face, lose every comparison and
+        leave the interval as it was.
+    */
+    bool HitBox(const glm::vec3& pMin, const glm::vec3& pMax, const glm::vec3& start,
+                const glm::vec3& invDir, float tMax) {
+        float tNear = 0;
+        float tFar = tMax;
+        for (int a = 0; a < 3; ++a) {
+            float t0 = (pMin[a] - start[a]) * invDir[a];
+            float t1 = (pMax[a] - start[a]) * invDir[a];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            if (t0 > tNear)
+                tNear = t0;
+            if (t1 < tFar)
+                tFar = t1;
+        }
+        return tNear <= tFar;
+    }
+
+    // Moller-Trumbore: distance along dir, in units of its length, or -1 for a miss
+    float HitTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+                      const glm::vec3& start, const glm::vec3& dir) {
+        glm::vec3 e1 = v1 - v0;
+        glm::vec3 e2 = v2 - v0;
+        glm::vec3 p = glm::cross(dir, e2);
+        float det = glm::dot(e1, p);
+        if (det == 0)
+            return -1;
+        float invDet = 1 / det;
+
+        glm::vec3 s = start - v0;
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0 || u > 1)
+            return -1;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(dir, q) * invDet;
+        if (v < 0 || u + v > 1)
+            return -1;
+        return glm::dot(e2, q) * invDet;
+    }
+};
+
+Scene::Scene(const std::vector<Triangle>& triangles, const std::vector<Mesh>& meshes,
+             const std::vector<Material>& meshMaterials) {
+    size_t count = triangles.size();
+    for (const Mesh& mesh : meshes)
+        count += mesh.NumTriangles();
+    indices.reserve(3 * count);
+    materialIds.reserve(count);
+
+    std::map<std::pair<Key3, Key3>, uint32_t> ids;
+    auto materialId = [&](const glm::vec3& color, const glm::vec3& emittance) {
+        std::pair<Key3, Key3> key(MakeKey(color), MakeKey(emittance));
+        auto found = ids.find(key);
+        if (found == ids.end()) {
+            found = ids.insert(std::make_pair(key, uint32_t(materials.size()))).first;
+            materials.push_back({color, emittance});
+        }
+        return found->second;
+    };
+
+    // the triangles of the list share corners that are exactly equal
+    std::map<Key3, uint32_t> vertexIds;
+    for (const Triangle& triangle : triangles) {
+        const glm::vec3* corners[3] = { &triangle.v0, &triangle.v1, &triangle.v2 };
+        for (const glm::vec3* corner : corners) {
+            auto found = vertexIds.find(MakeKey(*corner));
+            if (found == vertexIds.end()) {
+                found = vertexIds.insert(std::make_pair(MakeKey(*corner), uint32_t(positions.size()))).first;
+                positions.push_back(*corner);
+            }
+            indices.push_back(found->second);
+        }
+        materialIds.push_back(materialId(triangle.color, triangle.emittance));
+    }
+
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        const Mesh& mesh = meshes[m];
+        uint32_t first = uint32_t(positions.size());
+        positions.insert(positions.end(), mesh.positions.begin(), mesh.positions.end());
+        for (uint32_t index : mesh.indices)
+            indices.push_back(first + index);
+
+        uint32_t id = materialId(meshMaterials[m].color, meshMaterials[m].emittance);
+        materialIds.insert(materialIds.end(), mesh.NumTriangles(), id);
+    }
+
+    Build();
+}
+
+void Scene::Build() {
+    uint32_t count = uint32_t(Size());
+    std::vector<glm::vec3> centroids(count), lower(count), upper(count);
+    primitives.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        glm::vec3 v0, v1, v2;
+        Vertices(i, v0, v1, v2);
+        lower[i] = glm::min(v0, glm::min(v1, v2));
+        upper[i] = glm::max(v0, glm::max(v1, v2));
+        centroids[i] = 0.5f * (lower[i] + upper[i]);
+        primitives[i] = i;
+    }
+
+    nodes.clear();
+    nodes.reserve(2 * count);
+    if (count > 0)
+        BuildNode(centroids, lower, upper, 0, count);
+}
+
+uint32_t Scene::BuildNode(std::vector<glm::vec3>& centroids, std::vector<glm::vec3>& lower,
+                          std::vector<glm::vec3>& upper, uint32_t begin, uint32_t end) {
+    uint32_t index = uint32_t(nodes.size());
+    nodes.push_back(Node());
+
+    glm::vec3 pMin(std::numeric_limits<float>::max()), pMax(-std::numeric_limits<float>::max());
+    glm::vec3 cMin = pMin, cMax = pMax;
+    for (uint32_t i = begin; i < end; ++i) {
+        uint32_t t = primitives[i];
+        pMin = glm::min(pMin, lower[t]);
+        pMax = glm::max(pMax, upper[t]);
+        cMin = glm::min(cMin, centroids[t]);
+        cMax = glm::max(cMax, centroids[t]);
+    }
+    nodes[index].pMin = pMin;
+    nodes[index].pMax = pMax;
+
+    uint32_t count = end - begin;
+    int axis = 0;
+    glm::vec3 extent = cMax - cMin;
+    if (extent.y > extent[axis])
+        axis = 1;
+    if (extent.z > extent[axis])
+        axis = 2;
+
+    uint32_t mid = begin;
+    if (count <= 1) {
+        mid = end;
+    } else if (extent[axis] <= 0) {
+        // every centroid in one place, no split separates them
+        mid = count <= MAX_LEAF_SIZE ? end : begin + count / 2;
+    } else {
+        // binned surface area heuristic along the widest axis of the centroids
+        struct Bucket {
+            uint32_t count;
+            glm::vec3 pMin, pMax;
+        } buckets[SAH_BUCKETS];
+        for (Bucket& b : buckets) {
+            b.count = 0;
+            b.pMin = glm::vec3(std::numeric_limits<float>::max());
+            b.pMax = glm::vec3(-std::numeric_limits<float>::max());
+        }
+
+        auto bucketOf = [&](uint32_t t) {
+            int b = int(SAH_BUCKETS * (centroids[t][axis] - cMin[axis]) / extent[axis]);
+            return std::min(b, SAH_BUCKETS - 1);
+        };
+        for (uint32_t i = begin; i < end; ++i) {
+            uint32_t t = primitives[i];
+            Bucket& b = buckets[bucketOf(t)];
+            ++b.count;
+            b.pMin = glm::min(b.pMin, lower[t]);
+            b.pMax = glm::max(b.pMax, upper[t]);
+        }
+
+        // cost of splitting after each bucket, sweeping from the right
+        float rightCost[SAH_BUCKETS];
+        uint32_t rightCount = 0;
+        glm::vec3 rMin(std::numeric_limits<float>::max()), rMax(-std::numeric_limits<float>::max());
+        for (int b = SAH_BUCKETS - 1; b > 0; --b) {
+            rightCount += buckets[b].count;
+            rMin = glm::min(rMin, buckets[b].pMin);
+            rMax = glm::max(rMax, buckets[b].pMax);
+            rightCost[b - 1] = rightCount * SurfaceArea(rMin, rMax);
+        }
+
+        int bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        uint32_t leftCount = 0;
+        glm::vec3 lMin(std::numeric_limits<float>::max()), lMax(-std::numeric_limits<float>::max());
+        for (int b = 0; b < SAH_BUCKETS - 1; ++b) {
+            leftCount += buckets[b].count;
+            lMin = glm::min(lMin, buckets[b].pMin);
+            lMax = glm::max(lMax, buckets[b].pMax);
+            float cost = leftCount * SurfaceArea(lMin, lMax) + rightCost[b];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = b;
+            }
+        }
+
+        float leafCost = float(count);
+        float splitCost = TRAVERSAL_COST + bestCost / SurfaceArea(pMin, pMax);
+        if (count <= MAX_LEAF_SIZE && leafCost <= splitCost) {
+            mid = end;
+        } else {
+            mid = uint32_t(std::partition(primitives.begin() + begin, primitives.begin() + end,
+                                          [&](uint32_t t) { return bucketOf(t) <= bestSplit; })
+                           - primitives.begin());
+            if (mid == begin || mid == end)
+                mid = begin + count / 2;
+        }
+    }
+
+    if (mid == end) {
+        nodes[index].offset = begin;
+        nodes[index].count = uint16_t(count);
+        nodes[index].axis = 0;
+        return index;
+    }
+
+    BuildNode(centroids, lower, upper, begin, mid);
+    uint32_t second = BuildNode(centroids, lower, upper, mid, end);
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = uint16_t(axis);
+    return index;
+}
+
+bool Scene::Intersect(const glm::vec3& start, const glm::vec3& direction,
+                      int& index, glm::vec3& position, float& distance) const {
+    glm::vec3 dir = glm::normalize(direction);
+    glm::vec3 invDir = 1.f / dir;
+    distance = std::numeric_limits<float>::max();
+    index = -1;
+    if (nodes.empty())
+        return false;
+
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    uint32_t current = 0;
+    while (true) {
+        const Node& node = nodes[current];
+        if (HitBox(node.pMin, node.pMax, start, invDir, distance)) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    glm::vec3 v0, v1, v2;
+                    Vertices(primitives[i], v0, v1, v2);
+                    float t = HitTriangle(v0, v1, v2, start, dir);
+                    if (t > 0 && t < distance) {
+                        distance = t;
+                        index = int(primitives[i]);
+                    }
+                }
+            } else if (dir[node.axis] < 0) {
+                // nearer child first, so farther boxes can be culled by the hit
+                stack[top++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[top++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+        if (top == 0)
+            break;
+        current = stack[--top];
+    }
+
+    if (index < 0)
+        return false;
+    position = start + distance * dir;
+    return true;
+}
+
+bool Scene::Occluded(const glm::vec3& start, const glm::vec3& end) const {
+    // distances are fractions of the segment, stop just short of the end point
+    return AnyHit(start, end - start, 1 - 1e-4f);
+}
+
+bool Scene::OccludedRay(const glm::vec3& start, const glm::vec3& dir) const {
+    return AnyHit(start, dir, std::numeric_limits<float>::max());
+}
+
+bool Scene::AnyHit(const glm::vec3& start, const glm::vec3& dir, float tMax) const {
+    glm::vec3 invDir = 1.f / dir;
+    if (nodes.empty())
+        return false;
+
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    uint32_t current = 0;
+    while (true) {
+        const Node& node = nodes[current];
+        if (HitBox(node.pMin, node.pMax, start, invDir, tMax)) {
+            if (node.count > 0) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+                    glm::vec3 v0, v1, v2;
+                    Vertices(primitives[i], v0, v1, v2);
+                    float t = HitTriangle(v0, v1, v2, start, dir);
+                    if (t > 0 && t < tMax)
+                        return true;
+                }
+            } else {
+                stack[top++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+        if (top == 0)
+            break;
+        current = stack[--top];
+    }
+
+    return false;
+}
+
+glm::vec3 Scene::Normal(int i) const {
+    glm::vec3 v0, v1, v2;
+    Vertices(uint32_t(i), v0, v1, v2);
+    return glm::normalize(glm::cross(v2 - v0, v1 - v0));
+}
+
+float Scene::Area(int i) const {
+    glm::vec3 v0, v1, v2;
+    Vertices(uint32_t(i), v0, v1, v2);
+    return 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
+}
+
+void Scene::Bounds(glm::vec3& pMin, glm::vec3& pMax) const {
+    if (nodes.empty()) {
+        pMin = glm::vec3(std::numeric_limits<float>::max());
+        pMax = glm::vec3(-std::numeric_limits<float>::max());
+        return;
+    }
+    pMin = nodes[0].pMin;
+    pMax = nodes[0].pMax;
+}
+
+size_t Scene::MemoryBytes() const {
+    return positions.size() * sizeof(glm::vec3)
+         + indices.size() * sizeof(uint32_t)
+         + materialIds.size() * sizeof(uint32_t)
+         + materials.size() * sizeof(Material)
+         + nodes.size() * sizeof(Node)
+         + primitives.size() * sizeof(uint32_t);
+}
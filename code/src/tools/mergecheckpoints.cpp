@@ -0,0 +1,117 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <bmp/bmp.h>
+
+#include <thinlens/film/checkpoint.h>
+#include <thinlens/film/film.h>
+
+using namespace std;
+
+/*
+    Merges checkpoints of independently seeded renders of
+    the same frame into one image. Checkpoints hold weighted
+    sums of samples, so merging is a matter of adding them up.
+*/
+
+void Usage(const char* program){
+    cerr << "Correct usage: " << program << " <output.bmp> <checkpoint> <checkpoint>... [options]" << endl;
+    cerr << "options:" << endl;
+    cerr << "  --checkpoint <file>   also write the merged film as a checkpoint" << endl;
+    cerr << "  --exposure <e>        scale radiance before tone mapping (default 1)" << endl;
+    cerr << "  --tonemap <curve>     none, reinhard or aces (default none)" << endl;
+    cerr << "  --srgb                encode output with the sRGB curve" << endl;
+}
+
+int main( int argc, char* argv[] )
+{
+    string outputPath;
+    string mergedPath;
+    vector<string> inputs;
+    ResolveSettings settings;
+
+    for(int a = 1; a < argc; ++a){
+        string arg = argv[a];
+        if(arg == "--checkpoint"){
+            if(a + 1 >= argc){
+                Usage(argv[0]);
+                return -1;
+            }
+            mergedPath = argv[++a];
+        } else if(arg == "--srgb"){
+            settings.srgb = true;
+        } else if(arg == "--exposure" || arg == "--tonemap"){
+            if(a + 1 >= argc){
+                Usage(argv[0]);
+                return -1;
+            }
+            stringstream value(argv[++a]);
+            string name;
+            if(arg == "--exposure" ? !(value >> settings.exposure) : !(value >> name && ParseToneMap(name, settings.toneMap))){
+                cerr << "invalid value for option " << arg << endl;
+                Usage(argv[0]);
+                return -1;
+            }
+        } else if(outputPath.empty()){
+            outputPath = arg;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    if(outputPath.empty() || inputs.empty()){
+        Usage(argv[0]);
+        return -1;
+    }
+
+    Film* merged = nullptr;
+    uint64_t samples = 0;
+    uint64_t seed = 0;
+    vector<uint64_t> seeds;
+    for(size_t i = 0; i < inputs.size(); ++i){
+        CheckpointData data;
+        if(!LoadCheckpoint(inputs[i], data))
+            return -1;
+
+        if(merged == nullptr){
+            int buckets = (data.channels - Film::CHANNELS) / Film::BUCKET_CHANNELS;
+            merged = new Film(data.width, data.height, buckets);
+        }
+
+        Film film(merged->Width(), merged->Height(), merged->Buckets());
+        if(!film.Restore(data)){
+            cerr << inputs[i] << " does not match " << inputs[0] << endl;
+            return -1;
+        }
+        merged->Merge(film);
+        samples += data.samples;
+
+        for(size_t s = 0; s < seeds.size(); ++s){
+            if(seeds[s] == data.seed)
+                cerr << "warning: " << inputs[i] << " shares its seed with another checkpoint, its samples are not independent" << endl;
+        }
+        seeds.push_back(data.seed);
+
+        // combined seed, so that resuming the merged result does not replay any of the inputs
+        seed = seed * 6364136223846793005ULL + data.seed;
+    }
+
+    cout << "Merged " << inputs.size() << " checkpoints, " << samples << " samples" << endl;
+
+    bitmap_image image(merged->Width(), merged->Height());
+    merged->Resolve(settings, image);
+    image.save_image(outputPath);
+
+    if(!mergedPath.empty()){
+        CheckpointWriter writer(mergedPath, merged->Width(), merged->Height(), merged->Channels());
+        if(!writer.IsOpen())
+            return -1;
+        writer.Submit(merged->Snapshot(), samples, seed);
+    }
+
+    delete merged;
+
+    return 0;
+}
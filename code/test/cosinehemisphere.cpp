@@ -0,0 +1,101 @@
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <thinlens/auxiliaries/utility.h>
+
+using namespace std;
+
+/*
+    Statistical checks of cosineHemisphereSample and its pdf.
+    Directions with density cos(theta) / pi have cos^2(theta)
+    uniform on [0, 1] and a mean cos(theta) of 2/3, and the pdf
+    integrates to 1 over the hemisphere. The engine is seeded,
+    so the outcome does not change from run to run.
+*/
+
+namespace {
+    const int SAMPLES = 200000;
+    const int BINS = 16;
+    // chi-square with BINS - 1 degrees of freedom exceeds this with probability 0.001
+    const double CHI_SQUARE_LIMIT = 37.70;
+    // about seven standard errors of the mean cosine at SAMPLES
+    const double MEAN_TOLERANCE = 4e-3;
+    const double INTEGRAL_TOLERANCE = 1e-3;
+    const float HEMISPHERE_EPSILON = 1e-5f;
+};
+
+bool CheckAxis(const vec3& axis, mt19937& rng){
+    uniform_real_distribution<float> uniform(0.f, 1.f);
+    vector<int> bins(BINS, 0);
+    double cosSum = 0;
+    bool ok = true;
+
+    for(int i = 0; i < SAMPLES; ++i){
+        vec3 w = cosineHemisphereSample(axis, vec2(uniform(rng), uniform(rng)));
+        float cosTheta = glm::dot(w, axis);
+        if(cosTheta < -HEMISPHERE_EPSILON || std::abs(glm::length(w) - 1) > 1e-4f){
+            if(ok)
+                cerr << "direction (" << w.x << ", " << w.y << ", " << w.z << ") is not a unit vector in the hemisphere" << endl;
+            ok = false;
+        }
+        cosTheta = glm::clamp(cosTheta, 0.f, 1.f);
+        cosSum += cosTheta;
+        bins[min(BINS - 1, int(cosTheta * cosTheta * BINS))]++;
+    }
+
+    double mean = cosSum / SAMPLES;
+    if(std::abs(mean - 2.0 / 3) > MEAN_TOLERANCE){
+        cerr << "mean cosine " << mean << " instead of 2/3" << endl;
+        ok = false;
+    }
+
+    double expected = double(SAMPLES) / BINS;
+    double chiSquare = 0;
+    for(int count : bins)
+        chiSquare += (count - expected) * (count - expected) / expected;
+    if(chiSquare > CHI_SQUARE_LIMIT){
+        cerr << "cos^2 is not uniform: chi-square " << chiSquare << " over " << BINS << " bins" << endl;
+        ok = false;
+    }
+    return ok;
+}
+
+// midpoint rule over theta and phi, with the solid angle sin(theta) dtheta dphi
+bool CheckIntegral(){
+    const int steps = 1000;
+    double dTheta = PI / 2 / steps;
+    double dPhi = 2 * PI / steps;
+    double integral = 0;
+    for(int i = 0; i < steps; ++i){
+        double theta = (i + 0.5) * dTheta;
+        integral += cosineHemisphereSamplePDF(float(std::cos(theta))) * std::sin(theta) * dTheta * dPhi * steps;
+    }
+    if(std::abs(integral - 1) > INTEGRAL_TOLERANCE){
+        cerr << "pdf integrates to " << integral << " over the hemisphere" << endl;
+        return false;
+    }
+    // nothing below the surface
+    return cosineHemisphereSamplePDF(-0.5f) == 0;
+}
+
+int main()
+{
+    mt19937 rng(29);
+    vector<vec3> axes = {
+        vec3(0, 0, 1), vec3(0, 0, -1), vec3(1, 0, 0), vec3(0, -1, 0),
+        glm::normalize(vec3(1, 2, -3))
+    };
+
+    bool ok = CheckIntegral();
+    for(const vec3& axis : axes){
+        if(!CheckAxis(axis, rng)){
+            cerr << "failed for the axis (" << axis.x << ", " << axis.y << ", " << axis.z << ")" << endl;
+            ok = false;
+        }
+    }
+
+    cout << (ok ? "cosine hemisphere sampling: passed" : "cosine hemisphere sampling: FAILED") << endl;
+    return ok ? 0 : 1;
+}